@@ -0,0 +1,245 @@
+#include <map>
+#include <tuple>
+#include <benchmark/benchmark.h>
+#include <arailib.hpp>
+#include <dbscan.hpp>
+#include "generators.hpp"
+
+using namespace arailib;
+using namespace dbscan;
+using namespace generators;
+
+// Arguments shared by the benchmarks below:
+//   kind    0 blobs, 1 moons, 2 uniform, 3 skewed
+//   eps     in hundredths of sqrt(dim), so that one value suits every dim
+//   index   an IndexType
+//   threads OpenMP threads, 0 for all
+// Results are written as JSON with
+//   dbscan_bench --benchmark_out=result.json --benchmark_out_format=json
+
+const vector<string> kind_names = {"blobs", "moons", "uniform", "skewed"};
+
+// generated once per (kind, n, dim) and shared by all benchmarks
+const Matrix<>& dataset(int kind, size_t n, size_t dim) {
+    static map<tuple<int, size_t, size_t>, Matrix<>> cache;
+    const auto key = make_tuple(kind, n, dim);
+    auto it = cache.find(key);
+    if (it == cache.end()) {
+        Matrix<> points;
+        if (kind == 0) points = make_blobs(n, dim);
+        else if (kind == 1) points = make_moons(n, dim);
+        else if (kind == 2) points = make_uniform(n, dim);
+        else points = make_skewed(n, dim);
+        it = cache.emplace(key, move(points)).first;
+    }
+    return it->second;
+}
+
+// the dataset written to a file once, as csv or binary
+string dataset_file(int kind, size_t n, size_t dim, const string& extension) {
+    const auto path = "/tmp/dbscan_bench_" + kind_names[kind] + "_" + to_string(n) + "_" +
+                      to_string(dim) + extension;
+    if (ifstream(path)) return path;
+
+    const auto& points = dataset(kind, n, dim);
+    if (extension == ".bin") {
+        save_binary(points, path);
+        return path;
+    }
+    ofstream ofs(path);
+    ofs.precision(17);
+    for (size_t i = 0; i < points.size(); ++i) {
+        for (size_t d = 0; d < dim; ++d) ofs << (d ? "," : "") << points[i][d];
+        ofs << '\n';
+    }
+    return path;
+}
+
+double eps_of(const benchmark::State& state, int arg) {
+    return state.range(arg) / 100.0 * sqrt(state.range(2));
+}
+
+// runs the benchmark body with the requested number of threads
+struct ThreadScope {
+    int previous;
+
+    ThreadScope(int n_threads) : previous(omp_get_max_threads()) {
+        if (n_threads > 0) omp_set_num_threads(n_threads);
+    }
+
+    ~ThreadScope() { omp_set_num_threads(previous); }
+};
+
+// args: kind, n, dim
+void BM_LoadCsv(benchmark::State& state) {
+    const auto path = dataset_file(state.range(0), state.range(1), state.range(2), ".csv");
+    for (auto _ : state) benchmark::DoNotOptimize(read_csv_matrix<double>(path));
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    state.SetLabel(kind_names[state.range(0)]);
+}
+BENCHMARK(BM_LoadCsv)
+        ->ArgNames({"kind", "n", "dim"})
+        ->ArgsProduct({{0}, {10000, 100000}, {2, 8, 32}})
+        ->Unit(benchmark::kMillisecond);
+
+// binary datasets are mapped; the scan pulls every page in
+void BM_LoadBinary(benchmark::State& state) {
+    const auto path = dataset_file(state.range(0), state.range(1), state.range(2), ".bin");
+    for (auto _ : state) {
+        const auto points = load_binary<double>(path);
+        double sum = 0;
+        for (size_t i = 0; i < points.size() * points.dim; ++i) sum += points.data()[i];
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    state.SetLabel(kind_names[state.range(0)]);
+}
+BENCHMARK(BM_LoadBinary)
+        ->ArgNames({"kind", "n", "dim"})
+        ->ArgsProduct({{0}, {10000, 100000}, {2, 8, 32}})
+        ->Unit(benchmark::kMillisecond);
+
+// index construction and the eps-neighborhoods of all points
+// args: kind, n, dim, eps, index, threads
+void BM_NeighborSearch(benchmark::State& state) {
+    const auto& points = dataset(state.range(0), state.range(1), state.range(2));
+    const auto eps = eps_of(state, 3);
+    const auto type = static_cast<IndexType>(state.range(4));
+    const ThreadScope threads(state.range(5));
+
+    size_t n_edges = 0;
+    for (auto _ : state) {
+        const auto index = make_index(type, points, eps);
+        const auto table = compute_eps_neighbors(*index, points.size(), eps);
+        n_edges = table.n_edges();
+    }
+    state.counters["neighbors"] = static_cast<double>(n_edges) / points.size();
+    state.SetItemsProcessed(state.iterations() * points.size());
+    state.SetLabel(kind_names[state.range(0)]);
+}
+BENCHMARK(BM_NeighborSearch)
+        ->ArgNames({"kind", "n", "dim", "eps", "index", "threads"})
+        ->ArgsProduct({{0, 1, 2, 3}, {10000, 100000}, {2}, {5, 10},
+                       {static_cast<int>(IndexType::grid), static_cast<int>(IndexType::kd_tree)},
+                       {1, 0}})
+        ->ArgsProduct({{0, 2}, {10000}, {8, 32}, {50},
+                       {static_cast<int>(IndexType::brute_force), static_cast<int>(IndexType::kd_tree),
+                        static_cast<int>(IndexType::ball_tree), static_cast<int>(IndexType::pivot),
+                        static_cast<int>(IndexType::quantized)},
+                       {1, 0}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+// labeling from precomputed neighborhoods
+// args: kind, n, dim, eps, minpts, threads
+void BM_Labeling(benchmark::State& state) {
+    const auto& points = dataset(state.range(0), state.range(1), state.range(2));
+    const auto eps = eps_of(state, 3);
+    const int minpts = state.range(4);
+    const ThreadScope threads(state.range(5));
+    const auto table = DBSCAN(eps, minpts).compute_eps_neighbors(points);
+
+    size_t n_clusters = 0;
+    for (auto _ : state) {
+        const auto labels = label_clusters(points.size(), minpts, [&](int id) { return table[id]; });
+        n_clusters = make_clusters(labels).size();
+    }
+    state.counters["clusters"] = n_clusters;
+    state.SetItemsProcessed(state.iterations() * points.size());
+    state.SetLabel(kind_names[state.range(0)]);
+}
+BENCHMARK(BM_Labeling)
+        ->ArgNames({"kind", "n", "dim", "eps", "minpts", "threads"})
+        ->ArgsProduct({{0, 1, 3}, {100000}, {2}, {5, 10}, {5, 20}, {1, 0}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+// everything fit does from a Matrix
+// args: kind, n, dim, eps, minpts, threads
+void BM_Fit(benchmark::State& state) {
+    const auto& points = dataset(state.range(0), state.range(1), state.range(2));
+    const ThreadScope threads(state.range(5));
+
+    auto dbscan = DBSCAN(eps_of(state, 3), state.range(4));
+    for (auto _ : state) dbscan.fit(points);
+    state.counters["clusters"] = dbscan.clusters.size();
+    state.SetItemsProcessed(state.iterations() * points.size());
+    state.SetLabel(kind_names[state.range(0)]);
+}
+BENCHMARK(BM_Fit)
+        ->ArgNames({"kind", "n", "dim", "eps", "minpts", "threads"})
+        ->ArgsProduct({{0, 1, 2, 3}, {10000, 100000}, {2, 3}, {10}, {5}, {1, 0}})
+        ->ArgsProduct({{0}, {10000}, {8, 16, 32}, {50}, {5, 20}, {1, 0}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+// labeling 100000 points against a model fitted on n points
+// args: kind, n, dim, eps, threads
+void BM_Predict(benchmark::State& state) {
+    const auto& points = dataset(state.range(0), state.range(1), state.range(2));
+    const auto& queries = dataset(state.range(0), 100000, state.range(2));
+    const ThreadScope threads(state.range(4));
+
+    auto dbscan = DBSCAN(eps_of(state, 3), 5);
+    dbscan.fit(points);
+    const auto model = dbscan.make_model();
+    vector<int> labels(queries.size());
+    for (auto _ : state) model.predict(queries, labels.data());
+    state.counters["core_points"] = model.size();
+    state.SetItemsProcessed(state.iterations() * queries.size());
+    state.SetLabel(kind_names[state.range(0)]);
+}
+BENCHMARK(BM_Predict)
+        ->ArgNames({"kind", "n", "dim", "eps", "threads"})
+        ->ArgsProduct({{0, 3}, {10000, 100000}, {2}, {10}, {1, 0}})
+        ->ArgsProduct({{0}, {10000}, {32}, {50}, {1, 0}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+// an NN-Descent graph over the blobs, built and saved once per (n, dim)
+const GraphIndex& blob_graph(size_t n, size_t dim) {
+    static map<pair<size_t, size_t>, GraphIndex> cache;
+    const auto key = make_pair(n, dim);
+    auto it = cache.find(key);
+    if (it == cache.end()) it = cache.emplace(key, build_nn_descent_graph(dataset(0, n, dim))).first;
+    return it->second;
+}
+
+// args: n, dim, format (0 csv, 1 binary)
+void BM_GraphLoad(benchmark::State& state) {
+    const size_t n = state.range(0), dim = state.range(1);
+    const auto& points = dataset(0, n, dim);
+    const auto path = "/tmp/dbscan_bench_graph_" + to_string(n) + "_" + to_string(dim) +
+                      (state.range(2) ? ".bin" : ".csv");
+    if (!ifstream(path)) const_cast<GraphIndex&>(blob_graph(n, dim)).save(path);
+
+    GraphIndex graph;
+    for (auto _ : state) graph.load(points, path, n);
+    state.counters["edges"] = graph.n_edges();
+    state.SetItemsProcessed(state.iterations() * graph.n_edges());
+}
+BENCHMARK(BM_GraphLoad)
+        ->ArgNames({"n", "dim", "format"})
+        ->ArgsProduct({{10000, 100000}, {8}, {0, 1}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+// self_range_search from every node
+// args: n, dim, eps, threads
+void BM_SelfRangeSearch(benchmark::State& state) {
+    const auto& graph = blob_graph(state.range(0), state.range(1));
+    const auto eps = state.range(2) / 100.0 * sqrt(state.range(1));
+    const ThreadScope threads(state.range(3));
+
+    size_t n_edges = 0;
+    for (auto _ : state) n_edges = graph.self_range_search_all(eps).n_edges();
+    state.counters["neighbors"] = static_cast<double>(n_edges) / graph.size();
+    state.SetItemsProcessed(state.iterations() * graph.size());
+}
+BENCHMARK(BM_SelfRangeSearch)
+        ->ArgNames({"n", "dim", "eps", "threads"})
+        ->ArgsProduct({{10000, 100000}, {8, 32}, {50}, {1, 0}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,98 @@
+//
+// Synthetic datasets for the benchmarks, generated in process so that
+// results do not depend on files lying around.
+//
+
+#ifndef DBSCAN_GENERATORS_HPP
+#define DBSCAN_GENERATORS_HPP
+
+#include <random>
+#include <arailib.hpp>
+
+using namespace arailib;
+
+namespace generators {
+    // isotropic Gaussian blobs around n_centers random centers in [0, 10)^dim
+    Matrix<> make_blobs(size_t n, size_t dim, size_t n_centers = 5, double stddev = 0.5,
+                        unsigned seed = 0) {
+        mt19937 engine(seed);
+        uniform_real_distribution<double> uniform(0, 10);
+        normal_distribution<double> normal(0, stddev);
+
+        Matrix<> centers(n_centers, dim);
+        for (size_t i = 0; i < n_centers * dim; ++i) centers.data()[i] = uniform(engine);
+
+        Matrix<> points(n, dim);
+        for (size_t i = 0; i < n; ++i) {
+            const auto center = centers.row_data(i % n_centers);
+            for (size_t d = 0; d < dim; ++d) points.row_data(i)[d] = center[d] + normal(engine);
+        }
+        return points;
+    }
+
+    // two interleaving half circles (as scikit-learn's make_moons) in the
+    // first two coordinates; every coordinate gets Gaussian noise
+    Matrix<> make_moons(size_t n, size_t dim = 2, double noise = 0.05, unsigned seed = 0) {
+        mt19937 engine(seed);
+        uniform_real_distribution<double> angle(0, pi);
+        normal_distribution<double> normal(0, noise);
+
+        Matrix<> points(n, max<size_t>(dim, 2));
+        for (size_t i = 0; i < n; ++i) {
+            const auto t = angle(engine);
+            const auto row = points.row_data(i);
+            if (i % 2 == 0) {
+                row[0] = cos(t);
+                row[1] = sin(t);
+            }
+            else {
+                row[0] = 1 - cos(t);
+                row[1] = 0.5 - sin(t);
+            }
+            for (size_t d = 0; d < points.dim; ++d) row[d] += normal(engine);
+        }
+        return points;
+    }
+
+    // uniform noise in [0, side)^dim
+    Matrix<> make_uniform(size_t n, size_t dim, double side = 10, unsigned seed = 0) {
+        mt19937 engine(seed);
+        uniform_real_distribution<double> uniform(0, side);
+        Matrix<> points(n, dim);
+        for (size_t i = 0; i < n * dim; ++i) points.data()[i] = uniform(engine);
+        return points;
+    }
+
+    // Gaussian blobs whose spread doubles from one to the next, and which
+    // get fewer points the wider they are, so that density varies by orders
+    // of magnitude across the dataset
+    Matrix<> make_skewed(size_t n, size_t dim, size_t n_centers = 5, unsigned seed = 0) {
+        mt19937 engine(seed);
+        uniform_real_distribution<double> uniform(0, 10);
+        normal_distribution<double> normal(0, 1);
+
+        // blob c holds a share 2^-(c+1) of the points, the last one the rest
+        vector<size_t> blob_of(n);
+        for (size_t i = 0, c = 0, end = n / 2; i < n; ++i) {
+            if (i >= end && c + 1 < n_centers) {
+                ++c;
+                end += (n - end) / 2;
+            }
+            blob_of[i] = c;
+        }
+
+        Matrix<> centers(n_centers, dim);
+        for (size_t i = 0; i < n_centers * dim; ++i) centers.data()[i] = uniform(engine);
+
+        Matrix<> points(n, dim);
+        for (size_t i = 0; i < n; ++i) {
+            const auto c = blob_of[i];
+            const auto stddev = 0.1 * (1 << c);
+            for (size_t d = 0; d < dim; ++d)
+                points.row_data(i)[d] = centers.row_data(c)[d] + stddev * normal(engine);
+        }
+        return points;
+    }
+}
+
+#endif //DBSCAN_GENERATORS_HPP
@@ -5,14 +5,32 @@
 #include <vector>
 #include <algorithm>
 #include <iterator>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <atomic>
+#include <limits>
+#include <unordered_map>
 #include <numeric>
 #include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <chrono>
 #include <exception>
 #include <stdexcept>
 #include <omp.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <json.hpp>
 
 using namespace std;
@@ -91,61 +109,491 @@ namespace arailib {
     template <typename T = double>
     using DistanceFunction = function<double(Data<T>, Data<T>)>;
 
+    // Read-only view of one row of a Matrix. Cheap to copy; the distance
+    // functions accept it wherever they accept a Data<T>.
     template <typename T = double>
-    auto euclidean_distance(const Data<T>& p1, const Data<T>& p2) {
-        float result = 0;
+    struct Row {
+        size_t id;
+        const T* x;
+        size_t dim;
+
+        Row(size_t id, const T* x, size_t dim) : id(id), x(x), dim(dim) {}
+
+        const T& operator [] (size_t i) const { return x[i]; }
+
+        size_t size() const { return dim; }
+        const T* begin() const { return x; }
+        const T* end() const { return x + dim; }
+    };
+
+    // allocation aligned to a cache line, so that rows of wide matrices
+    // start on SIMD-friendly boundaries
+    template <typename T>
+    shared_ptr<T> allocate_aligned(size_t n, size_t alignment = 64) {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, alignment, max<size_t>(n, 1) * sizeof(T)) != 0)
+            throw bad_alloc();
+        return shared_ptr<T>(static_cast<T*>(ptr), [](T* p) { free(p); });
+    }
+
+    // Row-major n_rows x dim matrix held in a single aligned block. Copies are
+    // shallow and share the block, so a Matrix can be passed around by value
+    // and kept by indexes without duplicating the data.
+    template <typename T = double>
+    struct Matrix {
+        size_t n_rows;
+        size_t dim;
+        size_t capacity;  // rows the block can hold
+        shared_ptr<T> storage;
+
+        Matrix() : n_rows(0), dim(0), capacity(0) {}
+
+        Matrix(size_t n_rows, size_t dim) :
+                n_rows(n_rows), dim(dim), capacity(n_rows),
+                storage(allocate_aligned<T>(n_rows * dim)) {}
+
+        // Appends rows, reallocating geometrically when the block is full.
+        // Rows beyond n_rows are invisible to shallow copies, so appending in
+        // place is safe as long as only one copy of a Matrix appends.
+        void append(const T* rows, size_t count) {
+            if (n_rows + count > capacity) {
+                const auto new_capacity = max(n_rows + count, 2 * n_rows);
+                auto new_storage = allocate_aligned<T>(new_capacity * dim);
+                copy(data(), data() + n_rows * dim, new_storage.get());
+                storage = move(new_storage);
+                capacity = new_capacity;
+            }
+            copy(rows, rows + count * dim, row_data(n_rows));
+            n_rows += count;
+        }
+
+        T* data() { return storage.get(); }
+        const T* data() const { return storage.get(); }
+
+        size_t size() const { return n_rows; }
+        bool empty() const { return n_rows == 0; }
+
+        T* row_data(size_t i) { return data() + i * dim; }
+        const T* row_data(size_t i) const { return data() + i * dim; }
+
+        Row<T> operator [] (size_t i) const { return Row<T>(i, row_data(i), dim); }
+    };
+
+    // Dataset -> Matrix, converting the scalar type if needed
+    template <typename T = double, typename U>
+    Matrix<T> to_matrix(const Dataset<U>& dataset) {
+        const auto dim = dataset.empty() ? 0 : dataset[0].size();
+        for (const auto& data : dataset) {
+            if (data.size() != dim) throw runtime_error("Inconsistent dimension!");
+        }
+
+        Matrix<T> matrix(dataset.size(), dim);
+#pragma omp parallel for
+        for (size_t i = 0; i < dataset.size(); ++i) {
+            copy(dataset[i].begin(), dataset[i].end(), matrix.row_data(i));
+        }
+        return matrix;
+    }
+
+    // distance functions accept anything with size() and operator[],
+    // e.g. Data<T> or a Row<T> of a Matrix<T>
+    template <typename P1, typename P2>
+    auto euclidean_distance(const P1& p1, const P2& p2) {
+        double result = 0;
         for (size_t i = 0; i < p1.size(); i++) {
-            result += std::pow(p1[i] - p2[i], 2);
+            const auto diff = p1[i] - p2[i];
+            result += diff * diff;
         }
         result = std::sqrt(result);
         return result;
     }
 
-    template <typename T = double>
-    auto manhattan_distance(const Data<T>& p1, const Data<T>& p2) {
-        float result = 0;
+    template <typename P1, typename P2>
+    auto manhattan_distance(const P1& p1, const P2& p2) {
+        double result = 0;
         for (size_t i = 0; i < p1.size(); i++) {
             result += std::abs(p1[i] - p2[i]);
         }
         return result;
     }
 
-    template <typename T = double>
-    auto l2_norm(const Data<T>& p) {
-        float result = 0;
+    template <typename P>
+    auto l2_norm(const P& p) {
+        double result = 0;
         for (size_t i = 0; i < p.size(); i++) {
-            result += std::pow(p[i], 2);
+            result += p[i] * p[i];
         }
         result = std::sqrt(result);
         return result;
     }
 
+    // Squared L2 kernels over raw rows, compared against range^2 by the
+    // neighbor scans so no sqrt is taken per pair. The AVX2 / AVX-512
+    // variants are compiled with per-function target attributes and picked
+    // at runtime, so the binary still runs on CPUs without them.
+    template <typename T>
+    T squared_l2_scalar(const T* a, const T* b, size_t dim) {
+        T result = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            const auto diff = a[i] - b[i];
+            result += diff * diff;
+        }
+        return result;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx2,fma")))
+    inline double squared_l2_avx2(const double* a, const double* b, size_t dim) {
+        __m256d sum = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= dim; i += 4) {
+            const auto diff = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+            sum = _mm256_fmadd_pd(diff, diff, sum);
+        }
+        __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+        half = _mm_add_sd(half, _mm_unpackhi_pd(half, half));
+        double result = _mm_cvtsd_f64(half);
+        for (; i < dim; ++i) {
+            const auto diff = a[i] - b[i];
+            result += diff * diff;
+        }
+        return result;
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline float squared_l2_avx2(const float* a, const float* b, size_t dim) {
+        __m256 sum = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= dim; i += 8) {
+            const auto diff = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            sum = _mm256_fmadd_ps(diff, diff, sum);
+        }
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_movehdup_ps(half));
+        float result = _mm_cvtss_f32(half);
+        for (; i < dim; ++i) {
+            const auto diff = a[i] - b[i];
+            result += diff * diff;
+        }
+        return result;
+    }
+
+    __attribute__((target("avx512f")))
+    inline double squared_l2_avx512(const double* a, const double* b, size_t dim) {
+        __m512d sum = _mm512_setzero_pd();
+        size_t i = 0;
+        for (; i + 8 <= dim; i += 8) {
+            const auto diff = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+            sum = _mm512_fmadd_pd(diff, diff, sum);
+        }
+        if (i < dim) {
+            const auto mask = static_cast<__mmask8>((1u << (dim - i)) - 1);
+            const auto diff = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, a + i),
+                                            _mm512_maskz_loadu_pd(mask, b + i));
+            sum = _mm512_fmadd_pd(diff, diff, sum);
+        }
+        alignas(64) double lanes[8];
+        _mm512_store_pd(lanes, sum);
+        return accumulate(lanes, lanes + 8, 0.0);
+    }
+
+    __attribute__((target("avx512f")))
+    inline float squared_l2_avx512(const float* a, const float* b, size_t dim) {
+        __m512 sum = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= dim; i += 16) {
+            const auto diff = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+            sum = _mm512_fmadd_ps(diff, diff, sum);
+        }
+        if (i < dim) {
+            const auto mask = static_cast<__mmask16>((1u << (dim - i)) - 1);
+            const auto diff = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                            _mm512_maskz_loadu_ps(mask, b + i));
+            sum = _mm512_fmadd_ps(diff, diff, sum);
+        }
+        alignas(64) float lanes[16];
+        _mm512_store_ps(lanes, sum);
+        return accumulate(lanes, lanes + 16, 0.0f);
+    }
+
+    // one query against n_rows consecutive rows; out[r] = |query - rows[r]|^2
+    template <typename T>
+    __attribute__((target("avx2,fma")))
+    void squared_l2_tile_avx2(const T* query, const T* rows, size_t n_rows, size_t dim, T* out) {
+        for (size_t r = 0; r < n_rows; ++r) out[r] = squared_l2_avx2(query, rows + r * dim, dim);
+    }
+
+    template <typename T>
+    __attribute__((target("avx512f")))
+    void squared_l2_tile_avx512(const T* query, const T* rows, size_t n_rows, size_t dim, T* out) {
+        for (size_t r = 0; r < n_rows; ++r) out[r] = squared_l2_avx512(query, rows + r * dim, dim);
+    }
+#endif
+
+    template <typename T>
+    void squared_l2_tile_scalar(const T* query, const T* rows, size_t n_rows, size_t dim, T* out) {
+        for (size_t r = 0; r < n_rows; ++r) out[r] = squared_l2_scalar(query, rows + r * dim, dim);
+    }
+
+    enum class SimdLevel { scalar, avx2, avx512 };
+
+    inline SimdLevel detect_simd_level() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return SimdLevel::avx512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::avx2;
+#endif
+        return SimdLevel::scalar;
+    }
+
+    inline SimdLevel simd_level() {
+        static const auto level = detect_simd_level();
+        return level;
+    }
+
+    template <typename T>
+    using SquaredL2Kernel = T (*)(const T*, const T*, size_t);
+
+    template <typename T>
+    using SquaredL2TileKernel = void (*)(const T*, const T*, size_t, size_t, T*);
+
+    template <typename T>
+    SquaredL2Kernel<T> squared_l2_kernel(SimdLevel level = simd_level()) {
+#if defined(__x86_64__) || defined(__i386__)
+        if (level == SimdLevel::avx512) return squared_l2_avx512;
+        if (level == SimdLevel::avx2) return squared_l2_avx2;
+#endif
+        return squared_l2_scalar<T>;
+    }
+
+    template <typename T>
+    SquaredL2TileKernel<T> squared_l2_tile_kernel(SimdLevel level = simd_level()) {
+#if defined(__x86_64__) || defined(__i386__)
+        if (level == SimdLevel::avx512) return squared_l2_tile_avx512<T>;
+        if (level == SimdLevel::avx2) return squared_l2_tile_avx2<T>;
+#endif
+        return squared_l2_tile_scalar<T>;
+    }
+
+    template <typename T>
+    T squared_l2(const T* a, const T* b, size_t dim) {
+        static const auto kernel = squared_l2_kernel<T>();
+        return kernel(a, b, dim);
+    }
+
+    // squared L2 between rows of uint8 codes (see QuantizedMatrix), exact in
+    // integers; 32 codes a step with AVX2
+    inline uint64_t squared_l2_u8_scalar(const uint8_t* a, const uint8_t* b, size_t dim) {
+        uint64_t result = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            const int diff = int(a[i]) - int(b[i]);
+            result += diff * diff;
+        }
+        return result;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx2")))
+    inline uint64_t squared_l2_u8_avx2(const uint8_t* a, const uint8_t* b, size_t dim) {
+        const auto zero = _mm256_setzero_si256();
+        __m256i sum = zero;
+        size_t i = 0;
+        for (; i + 32 <= dim; i += 32) {
+            const auto va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            const auto vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            // |a - b| in unsigned bytes, widened to 16 bits and squared in pairs
+            const auto diff = _mm256_sub_epi8(_mm256_max_epu8(va, vb), _mm256_min_epu8(va, vb));
+            const auto low = _mm256_unpacklo_epi8(diff, zero);
+            const auto high = _mm256_unpackhi_epi8(diff, zero);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(low, low));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(high, high));
+        }
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sum);
+        return accumulate(lanes, lanes + 8, uint64_t(0)) + squared_l2_u8_scalar(a + i, b + i, dim - i);
+    }
+#endif
+
+    inline uint64_t squared_l2_u8(const uint8_t* a, const uint8_t* b, size_t dim) {
+#if defined(__x86_64__) || defined(__i386__)
+        static const auto kernel = simd_level() == SimdLevel::scalar ? squared_l2_u8_scalar : squared_l2_u8_avx2;
+        return kernel(a, b, dim);
+#else
+        return squared_l2_u8_scalar(a, b, dim);
+#endif
+    }
+
+    // A dimension known at compile time; FixedDim<0> stands for one that is
+    // only known at run time.
+    template <size_t Dim>
+    using FixedDim = integral_constant<size_t, Dim>;
+
+    // With Dim != 0 the loop has a constant trip count, so it is unrolled and
+    // inlined into the caller instead of going through the dispatched kernel.
+    template <typename T, size_t Dim>
+    inline T squared_l2(const T* a, const T* b, size_t dim, FixedDim<Dim>) {
+        if (Dim == 0) return squared_l2(a, b, dim);
+        T sum = 0;
+        for (size_t i = 0; i < Dim; ++i) {
+            const auto diff = a[i] - b[i];
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    // Calls f(FixedDim<dim>()) for the common dimensions 2, 3, 4, 8 and 16,
+    // and f(FixedDim<0>()) for any other, so that hot loops written as
+    // generic lambdas get an instantiation specialized for the dimension.
+    template <typename F>
+    decltype(auto) dispatch_dim(size_t dim, F f) {
+        switch (dim) {
+            case 2: return f(FixedDim<2>());
+            case 3: return f(FixedDim<3>());
+            case 4: return f(FixedDim<4>());
+            case 8: return f(FixedDim<8>());
+            case 16: return f(FixedDim<16>());
+            default: return f(FixedDim<0>());
+        }
+    }
+
     template <typename T = double>
     auto clip(const T val, const T min_val, const T max_val) {
         return max(min(val, max_val), min_val);
     }
 
-    template <typename T = double>
-    auto cosine_similarity(const Data<T>& p1, const Data<T>& p2) {
-        float val = inner_product(p1.begin(), p1.end(), p2.begin(), 0.0)
+    template <typename P1, typename P2>
+    auto cosine_similarity(const P1& p1, const P2& p2) {
+        double val = inner_product(p1.begin(), p1.end(), p2.begin(), 0.0)
             / (l2_norm(p1) * l2_norm(p2));
-        return clip(val, static_cast<float>(-1), static_cast<float>(1));
+        return clip(val, -1.0, 1.0);
     }
 
     constexpr float pi = static_cast<const float>(3.14159265358979323846264338);
 
-    template <typename T = double>
-    auto angular_distance(const Data<T>& p1, const Data<T>& p2) {
+    template <typename P1, typename P2>
+    auto angular_distance(const P1& p1, const P2& p2) {
         return acos(cosine_similarity(p1, p2)) / pi;
     }
 
+    template <typename T = float>
     auto select_distance(const string& distance) {
-        if (distance == "euclidean") return euclidean_distance<float>;
-        if (distance == "manhattan") return manhattan_distance<float>;
-        if (distance == "angular")   return angular_distance<float>;
+        if (distance == "euclidean") return euclidean_distance<Data<T>, Data<T>>;
+        if (distance == "manhattan") return manhattan_distance<Data<T>, Data<T>>;
+        if (distance == "angular")   return angular_distance<Data<T>, Data<T>>;
         else throw runtime_error("invalid distance");
     }
 
+    // Metrics for the range-searching code, which only computes squared L2
+    // distances. A metric maps the points once (prepare) and eps to the
+    // euclidean radius that selects the same pairs (radius); every index and
+    // kernel then runs unchanged on the mapped points.
+    struct Euclidean {
+        static constexpr bool maps_points = false;
+
+        template <typename T>
+        static void prepare(T*, size_t) {}
+
+        static double radius(double eps) { return eps; }
+    };
+
+    // angular_distance, acos(cos) / pi. Points are scaled to unit length,
+    // where |a - b|^2 = 2 - 2 cos, so eps becomes a fixed L2 radius and no
+    // norm or acos is computed per pair. Zero vectors stay zero.
+    struct Angular {
+        static constexpr bool maps_points = true;
+
+        template <typename T>
+        static void prepare(T* row, size_t dim) {
+            double norm = 0;
+            for (size_t i = 0; i < dim; ++i) norm += static_cast<double>(row[i]) * row[i];
+            if (norm == 0) return;
+            const auto scale = 1 / std::sqrt(norm);
+            for (size_t i = 0; i < dim; ++i) row[i] = static_cast<T>(row[i] * scale);
+        }
+
+        static double radius(double eps) {
+            return std::sqrt(max(0.0, 2 - 2 * std::cos(clip(eps, 0.0, 1.0) * pi)));
+        }
+    };
+
+    // rows of points mapped in place by Metric
+    template <typename Metric, typename T>
+    void prepare_rows(Matrix<T>& points) {
+        if (!Metric::maps_points) return;
+#pragma omp parallel for
+        for (int i = 0; i < points.size(); ++i) Metric::prepare(points.row_data(i), points.dim);
+    }
+
+    // points as Metric sees them; shares the storage when nothing is mapped
+    template <typename Metric, typename T>
+    Matrix<T> prepare_points(const Matrix<T>& points) {
+        if (!Metric::maps_points) return points;
+        Matrix<T> prepared(points.size(), points.dim);
+#pragma omp parallel for
+        for (int i = 0; i < points.size(); ++i) {
+            copy(points.row_data(i), points.row_data(i) + points.dim, prepared.row_data(i));
+            Metric::prepare(prepared.row_data(i), points.dim);
+        }
+        return prepared;
+    }
+
+    // Rows of a Matrix<T> as uint8 codes on one grid, x[d] ~ offsets[d] +
+    // step * code[d], at a quarter of float's and an eighth of double's
+    // bytes. Each row keeps the norm of its rounding error, so that
+    // step * |code_a - code_b| -/+ (error_a + error_b) bounds |a - b| from
+    // below and above: a scan over the codes can drop or accept most pairs
+    // and leave only those near the radius to the exact rows.
+    template <typename T>
+    struct QuantizedMatrix {
+        size_t n_rows = 0;
+        size_t dim = 0;
+        double step = 1;
+        vector<double> offsets;
+        vector<uint8_t> codes;  // n_rows x dim
+        vector<double> errors;
+
+        QuantizedMatrix() = default;
+
+        QuantizedMatrix(const Matrix<T>& points) :
+                n_rows(points.size()), dim(points.dim), offsets(points.dim), codes(points.size() * points.dim),
+                errors(points.size()) {
+            // one step for every dimension keeps code distances isotropic
+            vector<double> highs(dim, -numeric_limits<double>::infinity());
+            fill(offsets.begin(), offsets.end(), numeric_limits<double>::infinity());
+            for (size_t i = 0; i < n_rows; ++i) {
+                for (size_t d = 0; d < dim; ++d) {
+                    offsets[d] = min<double>(offsets[d], points[i][d]);
+                    highs[d] = max<double>(highs[d], points[i][d]);
+                }
+            }
+            double range = 0;
+            for (size_t d = 0; d < dim; ++d) range = max(range, highs[d] - offsets[d]);
+            if (range > 0) step = range / 255;
+
+#pragma omp parallel for
+            for (int i = 0; i < n_rows; ++i) {
+                double error = 0;
+                for (size_t d = 0; d < dim; ++d) {
+                    const double x = points[i][d];
+                    const auto code = clip(round((x - offsets[d]) / step), 0.0, 255.0);
+                    codes[i * dim + d] = static_cast<uint8_t>(code);
+                    const auto diff = x - (offsets[d] + step * code);
+                    error += diff * diff;
+                }
+                errors[i] = sqrt(error);
+            }
+        }
+
+        size_t size() const { return n_rows; }
+
+        const uint8_t* row_codes(size_t i) const { return codes.data() + i * dim; }
+
+        size_t memory_usage() const {
+            return codes.size() + (errors.size() + offsets.size()) * sizeof(double);
+        }
+    };
+
     template <typename T = double>
     vector<T> split(string &input, char delimiter = ',') {
         std::istringstream stream(input);
@@ -159,56 +607,290 @@ namespace arailib {
         return result;
     }
 
+    const int n_max_threads = omp_get_max_threads();
+
+    // whole file in memory, followed by a '\0' so that strtod never runs
+    // past the end of the last field
+    vector<char> read_file(const string& path) {
+        ifstream ifs(path, ios::binary | ios::ate);
+        if (!ifs) throw runtime_error("Can't open file!: " + path);
+        const auto size = static_cast<size_t>(ifs.tellg());
+        vector<char> buffer(size + 1, '\0');
+        ifs.seekg(0);
+        ifs.read(buffer.data(), size);
+        return buffer;
+    }
+
+    // [begin, end) ranges covering buffer[begin, end), cut just after newlines
+    vector<pair<size_t, size_t>> split_at_newlines(const char* buffer, size_t begin,
+                                                   size_t end, size_t n_chunks) {
+        vector<pair<size_t, size_t>> chunks;
+        const auto chunk_size = max<size_t>((end - begin) / max<size_t>(n_chunks, 1), 1);
+        for (auto first = begin; first < end;) {
+            auto last = min(end, first + chunk_size);
+            while (last < end && buffer[last - 1] != '\n') ++last;
+            chunks.emplace_back(first, last);
+            first = last;
+        }
+        return chunks;
+    }
+
+    bool is_blank_line(const char* p, const char* end) {
+        for (; p < end && *p != '\n'; ++p) {
+            if (*p != ' ' && *p != '\t' && *p != '\r') return false;
+        }
+        return true;
+    }
+
+    size_t count_csv_rows(const char* p, const char* end) {
+        size_t n_rows = 0;
+        while (p < end) {
+            if (!is_blank_line(p, end)) ++n_rows;
+            p = find(p, end, '\n');
+            if (p < end) ++p;
+        }
+        return n_rows;
+    }
+
+    size_t count_csv_fields(const char* p, const char* end) {
+        const auto line_end = find(p, end, '\n');
+        return count(p, line_end, ',') + 1;
+    }
+
+    // Parses one line of n_fields numbers into out and moves p to the next
+    // line. Returns false if the line does not hold exactly n_fields numbers.
+    template <typename T>
+    bool parse_csv_row(const char*& p, const char* end, T* out, size_t n_fields) {
+        for (size_t i = 0; i < n_fields; ++i) {
+            // strtod would skip a newline as leading whitespace
+            if (p >= end || *p == '\n' || *p == ',') return false;
+            char* next;
+            const auto value = strtod(p, &next);
+            if (next == p) return false;
+            out[i] = static_cast<T>(value);
+            p = next;
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+            const auto separator = i + 1 < n_fields ? ',' : '\n';
+            if (p < end && *p != separator) return false;
+            if (p < end) ++p;
+            else if (i + 1 < n_fields) return false;
+        }
+        return true;
+    }
+
+    // moves p past any blank lines
+    void skip_blank_lines(const char*& p, const char* end) {
+        while (p < end && is_blank_line(p, end)) {
+            p = find(p, end, '\n');
+            if (p < end) ++p;
+        }
+    }
+
+    // parses an unsigned decimal integer at p; false if there is none or
+    // it overflows size_t
+    bool parse_uint(const char*& p, const char* end, size_t& value) {
+        if (p >= end || *p < '0' || *p > '9') return false;
+        value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            const size_t digit = *p - '0';
+            if (value > (numeric_limits<size_t>::max() - digit) / 10) return false;
+            value = value * 10 + digit;
+        }
+        return true;
+    }
+
+    // parses the "id," that starts a line of an i.csv file; the id is read as
+    // an integer, not a coordinate, so float rows can't round it, and must be
+    // a valid point index
+    bool parse_row_id(const char*& p, const char* end, size_t& id) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        if (!parse_uint(p, end, id) || id > static_cast<size_t>(numeric_limits<int>::max())) return false;
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+        if (p >= end || *p != ',') return false;
+        ++p;
+        return true;
+    }
+
+    void append_uint(string& out, size_t value) {
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value > 0);
+        while (n > 0) out += digits[--n];
+    }
+
+    void append_int(string& out, long long value) {
+        if (value < 0) {
+            out += '-';
+            append_uint(out, static_cast<size_t>(-(value + 1)) + 1);
+            return;
+        }
+        append_uint(out, static_cast<size_t>(value));
+    }
+
+    // Writes format(block), a string, for blocks [0, n_blocks) in order. A
+    // batch of blocks is formatted in parallel, then written in one go.
+    template <typename Format>
+    void write_blocks(ostream& os, size_t n_blocks, Format format) {
+        const size_t batch_size = 16 * n_max_threads;
+        vector<string> texts(batch_size);
+        for (size_t batch = 0; batch < n_blocks; batch += batch_size) {
+            const auto batch_end = min(n_blocks, batch + batch_size);
+#pragma omp parallel for schedule(dynamic, 1)
+            for (int block = batch; block < batch_end; ++block) texts[block - batch] = format(block);
+            for (auto block = batch; block < batch_end; ++block) os << texts[block - batch];
+        }
+    }
+
+    // Reads a CSV file of numbers (one row per line) into a Matrix. The file
+    // is cut into byte ranges at newline boundaries; rows are counted per
+    // range, then every range is parsed in parallel straight into its rows of
+    // the preallocated Matrix. Malformed lines are reported after the parallel
+    // region, never thrown from inside it.
     template <typename T = double>
-    Dataset<T> read_csv(const std::string &path, const int& nrows = -1,
-                        const bool &skip_header = false) {
-        std::ifstream ifs(path);
-        if (!ifs) throw runtime_error("Can't open file!");
-        std::string line;
+    Matrix<T> read_csv_matrix(const string& path, int nrows = -1, bool skip_header = false) {
+        const auto buffer = read_file(path);
+        const auto data = buffer.data();
+        const auto size = buffer.size() - 1;
+
+        const char* first = data;
+        if (skip_header) {
+            first = find(data, data + size, '\n');
+            if (first < data + size) ++first;
+        }
+        skip_blank_lines(first, data + size);
+        if (first == data + size) return Matrix<T>();
+
+        const auto dim = count_csv_fields(first, data + size);
+        const auto chunks = split_at_newlines(data, first - data, size, 4 * n_max_threads);
+        vector<size_t> row_offsets(chunks.size() + 1, 0);
+#pragma omp parallel for
+        for (int c = 0; c < chunks.size(); ++c) {
+            row_offsets[c + 1] = count_csv_rows(data + chunks[c].first, data + chunks[c].second);
+        }
+        partial_sum(row_offsets.begin(), row_offsets.end(), row_offsets.begin());
+
+        const auto n_rows = min(row_offsets.back(), static_cast<size_t>(nrows));
+        Matrix<T> matrix(n_rows, dim);
+        vector<string> errors(chunks.size());
+#pragma omp parallel for
+        for (int c = 0; c < chunks.size(); ++c) {
+            const char* p = data + chunks[c].first;
+            const auto end = data + chunks[c].second;
+            for (auto row = row_offsets[c]; row < min(row_offsets[c + 1], n_rows); ++row) {
+                skip_blank_lines(p, end);
+                if (!parse_csv_row(p, end, matrix.row_data(row), dim)) {
+                    errors[c] = "Can't parse row " + to_string(row) + " of " + path +
+                                " as " + to_string(dim) + " numbers";
+                    break;
+                }
+            }
+        }
+
+        for (const auto& error : errors) {
+            if (!error.empty()) throw runtime_error(error);
+        }
+        return matrix;
+    }
+
+    // Reads a directory of i.csv files (i in [0, n)) whose lines are
+    // "id,x1,x2,...". Files are parsed in parallel; the Matrix is sized by the
+    // largest id found rather than guessed, and ids that never appear are
+    // left as zero rows.
+    template <typename T = double>
+    Matrix<T> read_csv_dir_matrix(const string& path, int n) {
+        const auto n_files = max(n, 0);
+        vector<vector<size_t>> file_ids(n_files);
+        vector<vector<T>> file_values(n_files);
+        vector<size_t> file_dims(n_files, 0);
+        vector<string> errors(n_files);
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int i = 0; i < n_files; ++i) {
+            const string file_path = path + '/' + to_string(i) + ".csv";
+            vector<char> buffer;
+            try {
+                buffer = read_file(file_path);
+            }
+            catch (const exception& e) {
+                errors[i] = e.what();
+                continue;
+            }
+
+            const char* p = buffer.data();
+            const auto end = p + buffer.size() - 1;
+            skip_blank_lines(p, end);
+            if (p == end) continue;
+
+            const auto n_fields = count_csv_fields(p, end);
+            vector<T> row(n_fields - 1);
+            while (p < end) {
+                size_t id;
+                if (n_fields < 2 || !parse_row_id(p, end, id) || !parse_csv_row(p, end, row.data(), row.size())) {
+                    errors[i] = "Can't parse " + file_path + " as lines of an integer id and " +
+                                to_string(n_fields - 1) + " numbers";
+                    break;
+                }
+                file_ids[i].emplace_back(id);
+                file_values[i].insert(file_values[i].end(), row.begin(), row.end());
+                skip_blank_lines(p, end);
+            }
+            file_dims[i] = n_fields - 1;
+        }
+
+        for (const auto& error : errors) {
+            if (!error.empty()) throw runtime_error(error);
+        }
+
+        size_t dim = 0, n_rows = 0;
+        for (int i = 0; i < n_files; ++i) {
+            if (file_ids[i].empty()) continue;
+            if (dim == 0) dim = file_dims[i];
+            if (file_dims[i] != dim) throw runtime_error("Inconsistent dimension!: " + path);
+            n_rows = max(n_rows, *max_element(file_ids[i].begin(), file_ids[i].end()) + 1);
+        }
+
+        Matrix<T> matrix(n_rows, dim);
+        fill(matrix.data(), matrix.data() + n_rows * dim, T(0));
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int i = 0; i < n_files; ++i) {
+            for (size_t r = 0; r < file_ids[i].size(); ++r) {
+                copy(file_values[i].begin() + r * dim, file_values[i].begin() + (r + 1) * dim,
+                     matrix.row_data(file_ids[i][r]));
+            }
+        }
+        return matrix;
+    }
 
-        Dataset<T> series;
-        for (size_t i = 0; (i < nrows) && std::getline(ifs, line); ++i) {
-            // if first line is the header then skip
-            if (skip_header && (i == 0)) continue;
-            std::vector<T> v = split<T>(line);
-            series.push_back(Data<T>(i, v));
+    // Matrix -> Dataset, for code that still wants a vector per point
+    template <typename T = double>
+    Dataset<T> to_dataset(const Matrix<T>& matrix) {
+        Dataset<T> series(matrix.size());
+#pragma omp parallel for
+        for (int i = 0; i < matrix.size(); ++i) {
+            series[i] = Data<T>(i, vector<T>(matrix[i].begin(), matrix[i].end()));
         }
         return series;
     }
 
-    const int n_max_threads = omp_get_max_threads();
+    template <typename T = double>
+    Dataset<T> read_csv(const std::string &path, const int& nrows = -1,
+                        const bool &skip_header = false) {
+        return to_dataset(read_csv_matrix<T>(path, nrows, skip_header));
+    }
+
 
     template <typename T = double>
     Dataset<T> load_data(const string& path, int n = 0) {
         // file path
         if (path.rfind(".csv", path.size()) < path.size()) {
-            auto series = Dataset<T>();
-            ifstream ifs(path);
-            if (!ifs) throw runtime_error("Can't open file!");
-            string line;
-            for (size_t i = 0; (i < n) && std::getline(ifs, line); ++i) {
-                auto v = split(line);
-                series.push_back(Data<T>(i, v));
-            }
-            return series;
+            return to_dataset(read_csv_matrix<T>(path, n));
         }
 
         // dir path
-        auto series = Dataset<T>(n * 1000);
-#pragma omp parallel for
-        for (int i = 0; i < n; i++) {
-            const string data_path = path + '/' + to_string(i) + ".csv";
-            ifstream ifs(data_path);
-            if (!ifs) throw runtime_error("Can't open file!");
-            string line;
-            while(getline(ifs, line)) {
-                auto v = split(line);
-                const auto id = static_cast<size_t>(v[0]);
-                v.erase(v.begin());
-                series[id] = Data<T>(id, v);
-            }
-        }
-        return series;
+        return to_dataset(read_csv_dir_matrix<T>(path, n));
     }
 
     template<typename T>
@@ -244,13 +926,274 @@ namespace arailib {
         return (path.rfind(".csv", path.size()) < path.size());
     }
 
+    // read-only view of a whole file through mmap; MAP_PRIVATE, so writes
+    // through the mapping stay in memory and never reach the file
+    struct MappedFile {
+        void* addr = nullptr;
+        size_t size = 0;
+
+        MappedFile(const string& path) {
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw runtime_error("Can't open file!: " + path);
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                throw runtime_error("Can't stat file!: " + path);
+            }
+            size = static_cast<size_t>(st.st_size);
+
+            if (size > 0) {
+                addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED) {
+                    close(fd);
+                    throw runtime_error("Can't mmap file!: " + path);
+                }
+                madvise(addr, size, MADV_WILLNEED);
+            }
+            close(fd);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile() { if (addr) munmap(addr, size); }
+
+        char* data() const { return static_cast<char*>(addr); }
+    };
+
+    enum class DType : uint32_t { float32 = 1, float64 = 2 };
+
+    template <typename T> DType dtype_of();
+    template <> DType dtype_of<float>() { return DType::float32; }
+    template <> DType dtype_of<double>() { return DType::float64; }
+
+    // Binary dataset: this 64-byte header followed by the n_rows x dim
+    // row-major payload, which therefore starts cache-line aligned in a
+    // mapped file and can back a Matrix without being copied.
+    struct BinaryHeader {
+        char magic[8];
+        uint32_t version;
+        DType dtype;
+        uint64_t n_rows;
+        uint64_t dim;
+        char reserved[32];
+    };
+    static_assert(sizeof(BinaryHeader) == 64, "BinaryHeader must stay 64 bytes");
+
+    constexpr char binary_magic[8] = {'A', 'R', 'A', 'I', 'D', 'A', 'T', 'A'};
+
+    BinaryHeader make_binary_header(DType dtype, size_t n_rows, size_t dim) {
+        BinaryHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, binary_magic, sizeof(binary_magic));
+        header.version = 1;
+        header.dtype = dtype;
+        header.n_rows = n_rows;
+        header.dim = dim;
+        return header;
+    }
+
+    bool is_binary(const string& path) {
+        return (path.rfind(".bin", path.size()) < path.size());
+    }
+
+    // Loads a binary dataset. When the stored dtype is T, the Matrix points
+    // straight into the mapping and keeps it alive; otherwise it is converted.
+    template <typename T = double>
+    Matrix<T> load_binary(const string& path) {
+        const auto file = make_shared<MappedFile>(path);
+        if (file->size < sizeof(BinaryHeader)) throw runtime_error("Invalid binary file!: " + path);
+
+        BinaryHeader header;
+        memcpy(&header, file->data(), sizeof(header));
+        const auto value_size = header.dtype == DType::float32 ? sizeof(float) : sizeof(double);
+        if (memcmp(header.magic, binary_magic, sizeof(binary_magic)) != 0 ||
+            (header.dtype != DType::float32 && header.dtype != DType::float64) ||
+            file->size < sizeof(header) + header.n_rows * header.dim * value_size) {
+            throw runtime_error("Invalid binary file!: " + path);
+        }
+
+        const auto payload = file->data() + sizeof(header);
+        Matrix<T> matrix;
+        matrix.n_rows = header.n_rows;
+        matrix.dim = header.dim;
+        if (header.dtype == dtype_of<T>()) {
+            matrix.storage = shared_ptr<T>(file, reinterpret_cast<T*>(payload));
+            return matrix;
+        }
+
+        matrix = Matrix<T>(header.n_rows, header.dim);
+        const auto n_values = header.n_rows * header.dim;
+        if (header.dtype == DType::float32) {
+            const auto values = reinterpret_cast<const float*>(payload);
+            copy(values, values + n_values, matrix.data());
+        }
+        else {
+            const auto values = reinterpret_cast<const double*>(payload);
+            copy(values, values + n_values, matrix.data());
+        }
+        return matrix;
+    }
+
     template <typename T>
-    auto scan_knn_search(const Data<T>& query, int k, const Dataset<T> dataset,
+    void save_binary(const Matrix<T>& matrix, const string& path) {
+        ofstream ofs(path, ios::binary);
+        if (!ofs) throw runtime_error("Can't open file!: " + path);
+        const auto header = make_binary_header(dtype_of<T>(), matrix.size(), matrix.dim);
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs.write(reinterpret_cast<const char*>(matrix.data()),
+                  matrix.size() * matrix.dim * sizeof(T));
+    }
+
+    // Reads blocks of rows of a binary dataset with pread, converted to T, for
+    // files that are streamed rather than mapped or loaded whole. read may be
+    // called from several threads at once.
+    template <typename T = double>
+    struct BinaryReader {
+        string path;
+        int fd;
+        BinaryHeader header;
+
+        explicit BinaryReader(const string& path) : path(path) {
+            fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw runtime_error("Can't open file!: " + path);
+            struct stat st;
+            if (fstat(fd, &st) != 0 ||
+                pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                memcmp(header.magic, binary_magic, sizeof(binary_magic)) != 0 ||
+                (header.dtype != DType::float32 && header.dtype != DType::float64) ||
+                st.st_size < sizeof(header) + header.n_rows * header.dim * value_size()) {
+                close(fd);
+                throw runtime_error("Invalid binary file!: " + path);
+            }
+        }
+
+        BinaryReader(const BinaryReader&) = delete;
+        BinaryReader& operator=(const BinaryReader&) = delete;
+
+        ~BinaryReader() { close(fd); }
+
+        size_t size() const { return header.n_rows; }
+        size_t dim() const { return header.dim; }
+        size_t value_size() const {
+            return header.dtype == DType::float32 ? sizeof(float) : sizeof(double);
+        }
+
+        // rows [begin, begin + count) into out, count * dim values
+        void read(size_t begin, size_t count, T* out) const {
+            if (header.dtype == dtype_of<T>()) {
+                read_values(begin, count, out);
+            }
+            else if (header.dtype == DType::float32) {
+                vector<float> values(count * dim());
+                read_values(begin, count, values.data());
+                copy(values.begin(), values.end(), out);
+            }
+            else {
+                vector<double> values(count * dim());
+                read_values(begin, count, values.data());
+                copy(values.begin(), values.end(), out);
+            }
+        }
+
+        void read_values(size_t begin, size_t count, void* out) const {
+            const auto row_bytes = dim() * value_size();
+            auto dst = static_cast<char*>(out);
+            auto remaining = count * row_bytes;
+            auto offset = sizeof(header) + begin * row_bytes;
+            while (remaining > 0) {
+                const auto n_read = pread(fd, dst, remaining, offset);
+                if (n_read <= 0) throw runtime_error("Can't read file!: " + path);
+                dst += n_read;
+                offset += n_read;
+                remaining -= n_read;
+            }
+        }
+    };
+
+    // Streams a CSV file (one row per line) or a directory of i.csv files
+    // (lines "id,x1,x2,..." for i in [0, n)) into a binary dataset of
+    // scalar type T, without holding the whole dataset in memory. n is
+    // required for a directory, whose files are not listed.
+    template <typename T = double>
+    void convert_to_binary(const string& input_path, const string& binary_path, int n = -1) {
+        if (!is_csv(input_path) && n < 0)
+            throw runtime_error("A directory needs the number of i.csv files!: " + input_path);
+        const int fd = open(binary_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw runtime_error("Can't open file!: " + binary_path);
+
+        size_t n_rows = 0, dim = 0;
+        const auto write_row = [&](size_t id, const vector<T>& row) {
+            if (dim == 0) dim = row.size();
+            if (row.size() != dim) throw runtime_error("Inconsistent dimension!");
+            const auto offset = sizeof(BinaryHeader) + id * dim * sizeof(T);
+            if (pwrite(fd, row.data(), dim * sizeof(T), offset) != dim * sizeof(T))
+                throw runtime_error("Can't write file!: " + binary_path);
+            n_rows = max(n_rows, id + 1);
+        };
+
+        try {
+            string line;
+            if (is_csv(input_path)) {
+                ifstream ifs(input_path);
+                if (!ifs) throw runtime_error("Can't open file!: " + input_path);
+                for (size_t i = 0; (i < n) && getline(ifs, line); ++i) write_row(i, split<T>(line));
+            }
+            else {
+                for (int i = 0; i < n; ++i) {
+                    const string path = input_path + '/' + to_string(i) + ".csv";
+                    ifstream ifs(path);
+                    if (!ifs) throw runtime_error("Can't open file!: " + path);
+                    while (getline(ifs, line)) {
+                        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+                        const char* p = line.data();
+                        size_t id;
+                        if (!parse_row_id(p, line.data() + line.size(), id))
+                            throw runtime_error("Can't parse the id of a line of " + path + ": " + line);
+                        string values(p, line.data() + line.size());
+                        write_row(id, split<T>(values));
+                    }
+                }
+            }
+        }
+        catch (...) {
+            close(fd);
+            throw;
+        }
+
+        const auto header = make_binary_header(dtype_of<T>(), n_rows, dim);
+        const auto written = pwrite(fd, &header, sizeof(header), 0);
+        close(fd);
+        if (written != sizeof(header)) throw runtime_error("Can't write file!: " + binary_path);
+    }
+
+    // copy of n elements split across threads, e.g. out of a mapped file
+    template <typename T, typename U>
+    void parallel_copy(const T* from, size_t n, U* to) {
+        constexpr size_t block_size = 1 << 16;
+#pragma omp parallel for
+        for (long long begin = 0; begin < n; begin += block_size) {
+            copy(from + begin, from + min<size_t>(n, begin + block_size), to + begin);
+        }
+    }
+
+    // Matrix from a binary dataset (mapped, see load_binary), a CSV file or
+    // a directory of n i.csv files
+    template <typename T = double>
+    Matrix<T> load_matrix(const string& path, int n = -1) {
+        if (is_binary(path)) return load_binary<T>(path);
+        if (is_csv(path)) return read_csv_matrix<T>(path, n);
+        return read_csv_dir_matrix<T>(path, n);
+    }
+
+    template <typename T>
+    auto scan_knn_search(const Data<T>& query, int k, const Dataset<T>& dataset,
                          string distance = "euclidean") {
-        const auto df = select_distance(distance);
-        map<float, reference_wrapper<const Data<T>>> result_map;
+        const auto df = select_distance<T>(distance);
+        multimap<double, reference_wrapper<const Data<T>>> result_map;
         for (const auto& data : dataset) {
-            const auto dist = euclidean_distance(query, data);
+            const auto dist = df(query, data);
             result_map.emplace(dist, data);
             if (result_map.size() > k) result_map.erase(--result_map.cend());
         }
@@ -262,6 +1205,129 @@ namespace arailib {
 
         return result;
     }
+
+    // candidates a PivotTable search skipped on their pivot bound, and those
+    // whose distance it computed
+    struct PivotCounts {
+        size_t n_pruned = 0;
+        size_t n_evaluated = 0;
+    };
+
+    // LAESA pivot table: the euclidean distances from every point to a few
+    // pivots, chosen farthest-first. For any pivot p, |d(q, p) - d(x, p)| is
+    // a lower bound of d(q, x), so a candidate x is skipped as soon as one
+    // pivot's bound reaches the search radius, before its distance is
+    // computed. This pays off where grids and trees do not, in high
+    // dimensions, when the data has a low intrinsic dimension.
+    template <typename T>
+    struct PivotTable {
+        Matrix<T> points;
+        vector<int> pivots;
+        vector<double> distances;  // n x n_pivots, per point
+
+        PivotTable(const Matrix<T>& points, size_t n_pivots = 16) : points(points) {
+            const auto n = points.size();
+            n_pivots = min(n_pivots, n);
+            distances.resize(n * n_pivots);
+
+            // each pivot is the point farthest from those chosen before it
+            vector<double> nearest(n, numeric_limits<double>::infinity());
+            int pivot = 0;
+            for (size_t j = 0; j < n_pivots; ++j) {
+                pivots.emplace_back(pivot);
+#pragma omp parallel for
+                for (int id = 0; id < n; ++id) {
+                    const double dist = sqrt(squared_l2(points.row_data(id), points.row_data(pivot), points.dim));
+                    distances[id * n_pivots + j] = dist;
+                    nearest[id] = min(nearest[id], dist);
+                }
+                pivot = static_cast<int>(max_element(nearest.begin(), nearest.end()) - nearest.begin());
+            }
+        }
+
+        size_t size() const { return points.size(); }
+
+        size_t n_pivots() const { return pivots.size(); }
+
+        const double* pivot_distances(int id) const { return distances.data() + id * n_pivots(); }
+
+        vector<double> query_distances(const T* query) const {
+            vector<double> result(n_pivots());
+            for (size_t j = 0; j < n_pivots(); ++j) {
+                result[j] = sqrt(squared_l2(query, points.row_data(pivots[j]), points.dim));
+            }
+            return result;
+        }
+
+        // whether some pivot bounds d(query, id) from below by at least range
+        bool excluded(const double* query_pivots, int id, double range) const {
+            const auto row = pivot_distances(id);
+            for (size_t j = 0; j < n_pivots(); ++j) {
+                if (abs(query_pivots[j] - row[j]) >= range) return true;
+            }
+            return false;
+        }
+
+        // appends the ids within range of query, except skip_id, to result
+        void range_search(const T* query, const double* query_pivots, double range,
+                          vector<int>& result, PivotCounts& counts, int skip_id = -1) const {
+            // the slack keeps rounding in the bound from dropping a pair the
+            // distance itself would accept
+            const auto bound = range * (1 + 1e-9);
+            const auto threshold = range * range;
+            for (int id = 0; id < size(); ++id) {
+                if (id == skip_id) continue;
+                if (excluded(query_pivots, id, bound)) {
+                    ++counts.n_pruned;
+                    continue;
+                }
+                ++counts.n_evaluated;
+                if (squared_l2(query, points.row_data(id), points.dim) < threshold) result.emplace_back(id);
+            }
+        }
+
+        // ids of the k nearest points to query, nearest first; a candidate is
+        // skipped once its bound reaches the k-th distance found so far
+        vector<int> knn_search(const T* query, int k, PivotCounts& counts) const {
+            if (k <= 0) return {};
+            const auto query_pivots = query_distances(query);
+            counts.n_evaluated += n_pivots();
+            vector<pair<double, int>> heap;  // max-heap of (distance, id)
+            for (int id = 0; id < size(); ++id) {
+                if (heap.size() == k && excluded(query_pivots.data(), id, heap.front().first * (1 + 1e-9))) {
+                    ++counts.n_pruned;
+                    continue;
+                }
+                ++counts.n_evaluated;
+                const double dist = sqrt(squared_l2(query, points.row_data(id), points.dim));
+                if (heap.size() < k) {
+                    heap.emplace_back(dist, id);
+                    push_heap(heap.begin(), heap.end());
+                } else if (dist < heap.front().first) {
+                    pop_heap(heap.begin(), heap.end());
+                    heap.back() = {dist, id};
+                    push_heap(heap.begin(), heap.end());
+                }
+            }
+            sort_heap(heap.begin(), heap.end());
+            vector<int> result;
+            for (const auto& entry : heap) result.emplace_back(entry.second);
+            return result;
+        }
+    };
+
+    // scan_knn_search in euclidean distance over a PivotTable built on
+    // to_matrix(dataset), pruning with its pivots; counts, if given, receives
+    // the pruned and evaluated candidates
+    template <typename T>
+    auto scan_knn_search(const Data<T>& query, int k, const Dataset<T>& dataset,
+                         const PivotTable<T>& table, PivotCounts* counts = nullptr) {
+        PivotCounts local_counts;
+        const auto ids = table.knn_search(query.x.data(), k, counts ? *counts : local_counts);
+        RefSeries<T> result;
+        for (const auto id : ids) result.emplace_back(dataset[id]);
+        return result;
+    }
 }
 
 #endif //ARAILIB_ARAILIB_HPP
\ No newline at end of file
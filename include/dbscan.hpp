@@ -10,300 +10,2912 @@
 using namespace arailib;
 
 namespace dbscan {
-    struct Point : public Data<> {
+    // a row of the Database together with the cluster it belongs to
+    template <typename T>
+    struct BasicPoint : public Row<T> {
         int cluster_id;
-        Point(Data<> data) : Data<>(data.id, data.x), cluster_id(-1) {}
+        BasicPoint(Row<T> row, int cluster_id) : Row<T>(row), cluster_id(cluster_id) {}
     };
 
-    using Database = vector<Point>;
+    using Point = BasicPoint<double>;
+
+    // Coordinates live in one contiguous row-major Matrix; labels are kept in
+    // a parallel array instead of inside each point.
+    template <typename T>
+    struct BasicDatabase {
+        Matrix<T> points;
+        vector<int> cluster_ids;
+
+        BasicDatabase() = default;
+        BasicDatabase(Matrix<T> points) : points(move(points)), cluster_ids(this->points.size(), -1) {}
+
+        size_t size() const { return points.size(); }
+        bool empty() const { return points.empty(); }
+        size_t dim() const { return points.dim; }
+
+        BasicPoint<T> operator[](size_t i) const { return BasicPoint<T>(points[i], cluster_ids[i]); }
+    };
+
+    using Database = BasicDatabase<double>;
 
     // arailib::Dataset -> dbscan::Database
-    auto convert(Dataset<> dataset) {
-        Database result;
-        for (const auto& data : dataset) {
-            result.emplace_back(Point(data));
-        }
-        return result;
+    template <typename T = double>
+    auto convert(const Dataset<T>& dataset) {
+        return BasicDatabase<T>(to_matrix<T>(dataset));
     }
 
     using Clusters = vector<vector<int>>;
 
-    struct Node {
-        const Data<> data;
-        vector<int> neighbors;
-        unordered_map<size_t, bool> added;
+    // Eps-neighbor lists in compressed sparse row form: the neighbors of
+    // point i are indices[offsets[i] .. offsets[i + 1]). Index may be narrowed
+    // (e.g. uint32_t) when the ids fit.
+    template <typename Index = int>
+    struct NeighborTable {
+        struct Neighbors {
+            const Index* first;
+            const Index* last;
+
+            const Index* begin() const { return first; }
+            const Index* end() const { return last; }
+            size_t size() const { return last - first; }
+            Index operator[](size_t i) const { return first[i]; }
+        };
+
+        vector<size_t> offsets;
+        vector<Index> indices;
+
+        NeighborTable() : offsets(1, 0) {}
+
+        NeighborTable(const vector<vector<int>>& lists) : offsets(lists.size() + 1, 0) {
+            for (size_t i = 0; i < lists.size(); ++i) offsets[i + 1] = offsets[i] + lists[i].size();
+            indices.resize(offsets.back());
+#pragma omp parallel for
+            for (int i = 0; i < lists.size(); ++i) {
+                copy(lists[i].begin(), lists[i].end(), indices.begin() + offsets[i]);
+            }
+        }
+
+        size_t size() const { return offsets.size() - 1; }
+        bool empty() const { return size() == 0; }
+        size_t n_edges() const { return indices.size(); }
+
+        Neighbors operator[](size_t i) const {
+            return {indices.data() + offsets[i], indices.data() + offsets[i + 1]};
+        }
+
+        size_t memory_usage() const {
+            return offsets.size() * sizeof(size_t) + indices.size() * sizeof(Index);
+        }
+    };
+
+    // NeighborTable with each list stored as zigzag varint deltas (the first
+    // one relative to the point itself). Sorted lists of nearby ids shrink to
+    // one or two bytes per edge; lists are decoded on the fly while iterating.
+    struct DeltaNeighborTable {
+        struct Iterator {
+            using iterator_category = input_iterator_tag;
+            using value_type = int;
+            using difference_type = ptrdiff_t;
+            using pointer = const int*;
+            using reference = int;
+
+            const uint8_t* p;
+            long long value;
+            size_t remaining;
+
+            int operator*() const { return static_cast<int>(value); }
+
+            Iterator& operator++() {
+                if (--remaining > 0) value += decode(p);
+                return *this;
+            }
+
+            bool operator==(const Iterator& o) const { return remaining == o.remaining; }
+            bool operator!=(const Iterator& o) const { return remaining != o.remaining; }
+        };
+
+        struct Neighbors {
+            const uint8_t* first;
+            long long origin;
+            size_t degree;
+
+            Iterator begin() const {
+                auto p = first;
+                const auto value = degree > 0 ? origin + decode(p) : origin;
+                return {p, value, degree};
+            }
+            Iterator end() const { return {nullptr, 0, 0}; }
+            size_t size() const { return degree; }
+        };
+
+        vector<size_t> offsets;  // byte offset of each list
+        vector<int> degrees;
+        vector<uint8_t> bytes;
+
+        template <typename Table>
+        DeltaNeighborTable(const Table& table) : offsets(table.size() + 1, 0), degrees(table.size()) {
+            const auto n = table.size();
+            vector<vector<uint8_t>> encoded(n);
+#pragma omp parallel for schedule(dynamic, 256)
+            for (int i = 0; i < n; ++i) {
+                long long previous = i;
+                for (const auto neighbor_id : table[i]) {
+                    encode(static_cast<long long>(neighbor_id) - previous, encoded[i]);
+                    previous = neighbor_id;
+                }
+                degrees[i] = static_cast<int>(table[i].size());
+            }
+
+            for (size_t i = 0; i < n; ++i) offsets[i + 1] = offsets[i] + encoded[i].size();
+            bytes.resize(offsets.back());
+#pragma omp parallel for
+            for (int i = 0; i < n; ++i) {
+                copy(encoded[i].begin(), encoded[i].end(), bytes.begin() + offsets[i]);
+            }
+        }
+
+        static void encode(long long delta, vector<uint8_t>& out) {
+            auto zigzag = (static_cast<unsigned long long>(delta) << 1) ^
+                          static_cast<unsigned long long>(delta >> 63);
+            while (zigzag >= 0x80) {
+                out.emplace_back(static_cast<uint8_t>(zigzag | 0x80));
+                zigzag >>= 7;
+            }
+            out.emplace_back(static_cast<uint8_t>(zigzag));
+        }
+
+        static long long decode(const uint8_t*& p) {
+            unsigned long long zigzag = 0;
+            for (int shift = 0; ; shift += 7) {
+                const auto byte = *p++;
+                zigzag |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+                if (byte < 0x80) break;
+            }
+            return static_cast<long long>(zigzag >> 1) ^ -static_cast<long long>(zigzag & 1);
+        }
+
+        size_t size() const { return degrees.size(); }
+        bool empty() const { return degrees.empty(); }
+
+        Neighbors operator[](size_t i) const {
+            return {bytes.data() + offsets[i], static_cast<long long>(i), static_cast<size_t>(degrees[i])};
+        }
+
+        size_t memory_usage() const {
+            return offsets.size() * sizeof(size_t) + degrees.size() * sizeof(int) + bytes.size();
+        }
+    };
+
+    // Answers "which points lie within range of point_id" over the rows of a
+    // Matrix. Implementations return ids sorted ascending and never include
+    // point_id. Indexes keep a shallow copy of the Matrix they were built on.
+    struct RangeIndex {
+        virtual ~RangeIndex() = default;
+        virtual vector<int> range_search(int point_id, double range) const = 0;
 
-        void init() { added[data.id] = true; }
-        Node() : data(Data<>(0, {0})) { init(); }
-        Node(Data<>& p) : data(move(p)) { init(); }
+        // range_search that also adds the number of distances it computed to
+        // n_distances; an index that does not count adds nothing
+        virtual vector<int> counted_range_search(int point_id, double range, size_t& /*n_distances*/) const {
+            return range_search(point_id, range);
+        }
+
+        // candidates skipped on a bound so far, by an index that counts them
+        virtual size_t n_pruned() const { return 0; }
+    };
+
+    // Measurements of DBSCAN::fit and GraphIndex operations, taken only while
+    // a FitStats is attached through their `stats` pointer. The pointer is
+    // null by default, and then nothing is timed or counted.
+    struct FitStats {
+        struct ThreadLoad {
+            double seconds = 0;
+            size_t n_points = 0;
+            size_t n_distances = 0;
+        };
+
+        map<string, double> phase_seconds;
+        size_t n_distances = 0;
+        size_t n_pruned = 0;  // candidates skipped without a distance
+        // [0]: points without neighbors, [k]: points with [2^(k-1), 2^k) neighbors
+        vector<size_t> neighbor_histogram;
+        size_t n_core = 0;
+        size_t n_border = 0;
+        size_t n_noise = 0;
+        size_t n_clusters = 0;
+        size_t neighbor_memory = 0;  // peak bytes of a neighbor table
+        vector<ThreadLoad> thread_loads;
+
+        static double seconds_since(chrono::system_clock::time_point start) {
+            return chrono::duration<double>(get_now() - start).count();
+        }
+
+        void add_phase(const string& phase, chrono::system_clock::time_point start) {
+            phase_seconds[phase] += seconds_since(start);
+        }
 
-        void add_neighbor(int node_id) {
-            if (added.find(node_id) != added.end()) return;
-            added[node_id] = true;
-            neighbors.emplace_back(node_id);
+        void add_thread_loads(const vector<ThreadLoad>& loads) {
+            if (thread_loads.size() < loads.size()) thread_loads.resize(loads.size());
+            for (size_t t = 0; t < loads.size(); ++t) {
+                thread_loads[t].seconds += loads[t].seconds;
+                thread_loads[t].n_points += loads[t].n_points;
+                thread_loads[t].n_distances += loads[t].n_distances;
+                n_distances += loads[t].n_distances;
+            }
         }
 
-        void clear_neighbor() {
-            neighbors.clear();
-            added.clear();
-            added[data.id] = true;
+        void set_neighbor_counts(const vector<int>& counts) {
+            neighbor_histogram.assign(1, 0);
+            for (const auto count : counts) {
+                size_t bucket = 0;
+                while (bucket < 32 && (size_t(1) << bucket) <= count) ++bucket;
+                if (bucket >= neighbor_histogram.size()) neighbor_histogram.resize(bucket + 1);
+                ++neighbor_histogram[bucket];
+            }
         }
 
-        auto get_n_neighbors() const { return neighbors.size(); }
+        json to_json() const {
+            json loads = json::array();
+            for (const auto& load : thread_loads) {
+                loads.push_back({{"seconds", load.seconds},
+                                 {"n_points", load.n_points},
+                                 {"n_distances", load.n_distances}});
+            }
+            return {{"phase_seconds", phase_seconds},
+                    {"n_distances", n_distances},
+                    {"n_pruned", n_pruned},
+                    {"neighbor_histogram", neighbor_histogram},
+                    {"n_core", n_core},
+                    {"n_border", n_border},
+                    {"n_noise", n_noise},
+                    {"n_clusters", n_clusters},
+                    {"neighbor_memory", neighbor_memory},
+                    {"thread_loads", loads}};
+        }
     };
 
-    struct GraphIndex {
-        vector<Node> nodes;
+    // Runs search(id, out) for every id in [0, n) in parallel, where search
+    // appends the neighbors of id to out, and packs the results into a
+    // NeighborTable: blocks of ids are searched concurrently (count), then each
+    // block's results are copied to their final offsets (fill).
+    template <typename Search>
+    NeighborTable<> build_neighbor_table(size_t n, Search search) {
+        constexpr size_t block_size = 1024;
+        const auto n_blocks = (n + block_size - 1) / block_size;
+
+        NeighborTable<> table;
+        table.offsets.assign(n + 1, 0);
+        vector<vector<int>> block_indices(n_blocks);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int block = 0; block < n_blocks; ++block) {
+            auto& indices = block_indices[block];
+            const auto end = min(n, (block + 1) * block_size);
+            for (auto id = block * block_size; id < end; ++id) {
+                const auto before = indices.size();
+                search(static_cast<int>(id), indices);
+                table.offsets[id + 1] = indices.size() - before;
+            }
+        }
+
+        partial_sum(table.offsets.begin(), table.offsets.end(), table.offsets.begin());
+        table.indices.resize(table.offsets.back());
+#pragma omp parallel for
+        for (int block = 0; block < n_blocks; ++block) {
+            auto& indices = block_indices[block];
+            copy(indices.begin(), indices.end(), table.indices.begin() + table.offsets[block * block_size]);
+            vector<int>().swap(indices);
+        }
+        return table;
+    }
+
+    // build_neighbor_table for search(id, out, n_distances), which also counts
+    // the distances it computes; every call is timed on its thread, and the
+    // phase, thread loads and table size are added to stats
+    template <typename Search>
+    NeighborTable<> build_measured_neighbor_table(size_t n, FitStats& stats, const string& phase,
+                                                  Search search) {
+        const auto start = get_now();
+        vector<FitStats::ThreadLoad> loads(omp_get_max_threads());
+        auto table = build_neighbor_table(n, [&](int id, vector<int>& out) {
+            auto& load = loads[omp_get_thread_num()];
+            const auto call_start = get_now();
+            search(id, out, load.n_distances);
+            load.seconds += FitStats::seconds_since(call_start);
+            ++load.n_points;
+        });
+        stats.add_phase(phase, start);
+        stats.add_thread_loads(loads);
+        stats.neighbor_memory = max(stats.neighbor_memory, table.memory_usage());
+        return table;
+    }
+
+    // Visited marks for graph traversals. Clearing is O(1): the epoch is
+    // bumped instead of touching every mark, so one list per thread can be
+    // reused for any number of queries.
+    struct VisitedList {
+        vector<uint32_t> marks;
+        uint32_t epoch = 0;
+
+        void reset(size_t n) {
+            if (marks.size() != n) {
+                marks.assign(n, 0);
+                epoch = 0;
+            }
+            if (++epoch == 0) {
+                fill(marks.begin(), marks.end(), 0);
+                epoch = 1;
+            }
+        }
 
-        auto size() const { return nodes.size(); }
+        // true the first time id is visited since the last reset
+        bool visit(int id) {
+            if (marks[id] == epoch) return false;
+            marks[id] = epoch;
+            return true;
+        }
+    };
 
-        auto empty() const { return nodes.empty(); }
+    // Groups directed edges by source into a NeighborTable whose rows are
+    // sorted, deduplicated and free of self loops. for_each_edge(block, emit)
+    // calls emit(from, to) for every edge of block b in [0, n_blocks); blocks
+    // are walked in parallel and edges are scattered into per-source buckets
+    // through atomic cursors, so no per-node set or lock is needed.
+    template <typename ForEachEdge>
+    NeighborTable<> build_adjacency(size_t n, size_t n_blocks, ForEachEdge for_each_edge,
+                                    bool bidirectional = false) {
+        vector<atomic<size_t>> cursors(n);
+#pragma omp parallel for
+        for (int i = 0; i < n; ++i) cursors[i].store(0, memory_order_relaxed);
 
-        auto begin() const { return nodes.begin(); }
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int block = 0; block < n_blocks; ++block) {
+            for_each_edge(block, [&](int from, int to) {
+                cursors[from].fetch_add(1, memory_order_relaxed);
+                if (bidirectional) cursors[to].fetch_add(1, memory_order_relaxed);
+            });
+        }
 
-        auto end() const { return nodes.end(); }
+        vector<size_t> offsets(n + 1, 0);
+        for (size_t i = 0; i < n; ++i) {
+            offsets[i + 1] = offsets[i] + cursors[i].load(memory_order_relaxed);
+            cursors[i].store(offsets[i], memory_order_relaxed);
+        }
 
-        auto& operator[](size_t i) { return nodes[i]; }
+        vector<int> scattered(offsets.back());
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int block = 0; block < n_blocks; ++block) {
+            for_each_edge(block, [&](int from, int to) {
+                scattered[cursors[from].fetch_add(1, memory_order_relaxed)] = to;
+                if (bidirectional) scattered[cursors[to].fetch_add(1, memory_order_relaxed)] = from;
+            });
+        }
 
-        auto& operator[](const Node &n) { return nodes[n.data.id]; }
+        NeighborTable<> table;
+        table.offsets.assign(n + 1, 0);
+#pragma omp parallel for schedule(dynamic, 256)
+        for (int i = 0; i < n; ++i) {
+            const auto first = scattered.begin() + offsets[i];
+            auto last = scattered.begin() + offsets[i + 1];
+            sort(first, last);
+            last = unique(first, last);
+            last = remove(first, last, i);
+            table.offsets[i + 1] = last - first;
+        }
 
-        const auto& operator[](size_t i) const { return nodes[i]; }
+        partial_sum(table.offsets.begin(), table.offsets.end(), table.offsets.begin());
+        table.indices.resize(table.offsets.back());
+#pragma omp parallel for schedule(dynamic, 256)
+        for (int i = 0; i < n; ++i) {
+            const auto first = scattered.begin() + offsets[i];
+            copy(first, first + table[i].size(), table.indices.begin() + table.offsets[i]);
+        }
+        return table;
+    }
 
-        const auto& operator[](const Node &n) const { return nodes[n.data.id]; }
+    // Keeps the first `degree` distinct neighbors of each node, self loops
+    // aside, in the order its row of `ordered` lists them, and returns them
+    // as sorted rows. Used to cap the degree of a loaded graph by file order,
+    // which does not depend on how the file was parsed in parallel.
+    NeighborTable<> first_neighbors(const NeighborTable<>& ordered, int degree) {
+        const auto n = ordered.size();
+        const size_t cap = max(degree, 0);
 
-        void init_data(Series<>& series) {
-            for (auto &point : series) {
-                nodes.emplace_back(point);
+        // a row keeps at most min(cap, row size) neighbors: fill each row at
+        // that bound, then close the gaps left by duplicates and self loops
+        vector<size_t> bounds(n + 1, 0);
+        for (size_t i = 0; i < n; ++i) bounds[i + 1] = bounds[i] + min(cap, ordered[i].size());
+        NeighborTable<> table;
+        table.offsets.assign(n + 1, 0);
+        table.indices.resize(bounds.back());
+#pragma omp parallel for schedule(dynamic, 256)
+        for (int i = 0; i < n; ++i) {
+            const auto first = table.indices.begin() + bounds[i];
+            const auto end = table.indices.begin() + bounds[i + 1];
+            auto last = first;
+            for (const auto neighbor_id : ordered[i]) {
+                if (last == end) break;
+                if (neighbor_id != i && find(first, last, neighbor_id) == last) *last++ = neighbor_id;
             }
+            sort(first, last);
+            table.offsets[i + 1] = last - first;
+        }
+
+        partial_sum(table.offsets.begin(), table.offsets.end(), table.offsets.begin());
+        for (size_t i = 0; i < n; ++i) {
+            const auto first = table.indices.begin() + bounds[i];
+            copy(first, first + (table.offsets[i + 1] - table.offsets[i]), table.indices.begin() + table.offsets[i]);
         }
+        table.indices.resize(table.offsets.back());
+        return table;
+    }
+
+    // Binary graph file: this 64-byte header, then n_nodes + 1 uint64 offsets
+    // and n_edges int32 neighbor ids, i.e. a GraphIndex adjacency table as is.
+    struct GraphHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t index_size;
+        uint64_t n_nodes;
+        uint64_t n_edges;
+        char reserved[32];
+    };
+    static_assert(sizeof(GraphHeader) == 64, "GraphHeader must stay 64 bytes");
+
+    constexpr char graph_magic[8] = {'A', 'R', 'A', 'I', 'G', 'R', 'P', 'H'};
+
+    // Proximity graph (e.g. a kNN graph) over the rows of a Matrix, frozen in
+    // CSR form: graph[i] is the sorted, duplicate-free neighbor list of node i.
+    // The Matrix is shared, not copied, so a GraphIndex loaded on the same
+    // points as a DBSCAN costs only its edges. As a RangeIndex it answers
+    // range searches approximately, by traversing the graph. Ranges are in
+    // Metric's distance (see Euclidean and Angular); a metric that maps the
+    // points keeps its own mapped copy.
+    template <typename T, typename Metric = Euclidean>
+    struct BasicGraphIndex : public RangeIndex {
+        Matrix<T> points;
+        NeighborTable<> adjacency;
+        FitStats* stats = nullptr;  // see FitStats
+
+        BasicGraphIndex() = default;
+        BasicGraphIndex(const Matrix<T>& points, NeighborTable<> adjacency) :
+                points(prepare_points<Metric>(points)), adjacency(move(adjacency)) {}
+
+        auto size() const { return adjacency.size(); }
+
+        auto empty() const { return adjacency.empty(); }
+
+        auto n_edges() const { return adjacency.n_edges(); }
+
+        auto n_neighbors(size_t i) const { return adjacency[i].size(); }
+
+        auto operator[](size_t i) const { return adjacency[i]; }
 
         void make_bidirectional() {
-            for (auto &node : nodes) {
-                for (const auto neighbor_id : node.neighbors) {
-                    nodes[neighbor_id].add_neighbor(node.data.id);
+            constexpr size_t block_size = 1024;
+            const auto n = size();
+            adjacency = build_adjacency(
+                    n, (n + block_size - 1) / block_size,
+                    [&](int block, auto emit) {
+                        const auto end = min(n, (block + 1) * block_size);
+                        for (auto i = block * block_size; i < end; ++i) {
+                            for (const auto neighbor_id : adjacency[i]) emit(i, neighbor_id);
+                        }
+                    },
+                    true);
+        }
+
+        // Parses edge lines "from,to[,to...]" in [p, end) and passes every edge
+        // to emit(from, to). Returns false at the first malformed line.
+        template <typename Emit>
+        static bool parse_edges(const char* p, const char* end, Emit emit) {
+            while (true) {
+                skip_blank_lines(p, end);
+                if (p >= end) return true;
+
+                size_t from, to;
+                if (!parse_uint(p, end, from)) return false;
+                while (p < end && *p == ',') {
+                    ++p;
+                    if (!parse_uint(p, end, to)) return false;
+                    emit(from, to);
                 }
+                while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+                if (p < end && *p++ != '\n') return false;
             }
         }
 
-        void load(Series<>& series, const string& graph_path, int n, int degree = -1) {
-            init_data(series);
+        // Edges are read from a binary graph (see save), a csv file, or a
+        // directory of n i.csv files. Text lines are "from,to" pairs or whole
+        // adjacency lists "from,to1,to2,..."; with degree != -1 only the first
+        // `degree` distinct neighbors of each node in file order are kept (see
+        // first_neighbors), whatever the file format. Text input is parsed in
+        // parallel (byte ranges of a csv file, or one file per task) into
+        // per-task edge blocks that build_adjacency merges without locks.
+        void load(const Matrix<T>& points, const string& graph_path, int n, int degree = -1) {
+            const auto start = get_now();
+            load_edges(points, graph_path, n, degree);
+            if (stats) stats->add_phase("load_graph", start);
+        }
 
-            // csv file
-            if (is_csv(graph_path)) {
-                ifstream ifs(graph_path);
-                if (!ifs) {
-                    const string message = "Can't open file!: " + graph_path;
-                    throw runtime_error(message);
-                }
+        void load_edges(const Matrix<T>& points, const string& graph_path, int n, int degree) {
+            this->points = prepare_points<Metric>(points);
+            const auto n_nodes = points.size();
 
-                string line;
-                while (getline(ifs, line)) {
-                    const auto ids = split<size_t>(line);
-                    nodes[ids[0]].add_neighbor(ids[1]);
-                    if (degree != -1 && nodes[ids[0]].get_n_neighbors() >= degree) break;
-                }
+            if (is_binary(graph_path)) {
+                load_binary_graph(graph_path);
+                if (degree != -1) adjacency = first_neighbors(adjacency, degree);
                 return;
             }
 
+            const auto read_edges = [&](const char* p, const char* end,
+                                        vector<pair<int, int>>& edges) {
+                return parse_edges(p, end, [&](size_t from, size_t to) {
+                    if (from >= n_nodes || to >= n_nodes) return;
+                    edges.emplace_back(from, to);
+                });
+            };
+
+            vector<vector<pair<int, int>>> edge_blocks;
+            vector<string> errors;
+
+            // csv file
+            if (is_csv(graph_path)) {
+                const auto buffer = read_file(graph_path);
+                const auto data = buffer.data();
+                const auto chunks = split_at_newlines(data, 0, buffer.size() - 1, 4 * n_max_threads);
+                edge_blocks.resize(chunks.size());
+                errors.resize(chunks.size());
+#pragma omp parallel for schedule(dynamic, 1)
+                for (int c = 0; c < chunks.size(); ++c) {
+                    if (!read_edges(data + chunks[c].first, data + chunks[c].second, edge_blocks[c]))
+                        errors[c] = "Can't parse edges in " + graph_path;
+                }
+            }
             // dir
-#pragma omp parallel
-            {
-#pragma omp for schedule(dynamic, 10) nowait
-                for (int i = 0; i < n; i++) {
+            else {
+                edge_blocks.resize(max(n, 0));
+                errors.resize(edge_blocks.size());
+#pragma omp parallel for schedule(dynamic, 10)
+                for (int i = 0; i < edge_blocks.size(); i++) {
                     const string path = graph_path + "/" + to_string(i) + ".csv";
-                    ifstream ifs(path);
-
-                    if (!ifs) {
-                        const string message = "Can't open file!: " + path;
-                        throw runtime_error(message);
+                    try {
+                        const auto buffer = read_file(path);
+                        const auto data = buffer.data();
+                        if (!read_edges(data, data + buffer.size() - 1, edge_blocks[i]))
+                            errors[i] = "Can't parse edges in " + path;
                     }
-
-                    string line;
-                    while (getline(ifs, line)) {
-                        const auto ids = split<size_t>(line);
-                        if (degree == -1 || nodes[ids[0]].get_n_neighbors() < degree) {
-                            nodes[ids[0]].add_neighbor(ids[1]);
-                        }
+                    catch (const exception& e) {
+                        errors[i] = e.what();
                     }
                 }
-            };
+            }
+
+            for (const auto& error : errors) {
+                if (!error.empty()) throw runtime_error(error);
+            }
+
+            if (degree != -1) {
+                // edges grouped by source in file order: blocks are in file
+                // order and so are the edges within a block
+                NeighborTable<> ordered;
+                ordered.offsets.assign(n_nodes + 1, 0);
+                for (const auto& edges : edge_blocks) {
+                    for (const auto& edge : edges) ++ordered.offsets[edge.first + 1];
+                }
+                partial_sum(ordered.offsets.begin(), ordered.offsets.end(), ordered.offsets.begin());
+                ordered.indices.resize(ordered.offsets.back());
+                vector<size_t> cursors(ordered.offsets.begin(), ordered.offsets.end() - 1);
+                for (const auto& edges : edge_blocks) {
+                    for (const auto& edge : edges) ordered.indices[cursors[edge.first]++] = edge.second;
+                }
+                adjacency = first_neighbors(ordered, degree);
+                return;
+            }
+
+            adjacency = build_adjacency(
+                    n_nodes, edge_blocks.size(),
+                    [&](int block, auto emit) {
+                        for (const auto& edge : edge_blocks[block]) emit(edge.first, edge.second);
+                    });
+        }
+
+        void load(const Series<T>& series, const string& graph_path, int n, int degree = -1) {
+            load(to_matrix<T>(series), graph_path, n, degree);
         }
 
         void load(const string& data_path, const string& graph_path,
                   int n = -1, int degree = -1) {
-            auto series = load_data(data_path, n);
-            load(series, graph_path, n, degree);
+            load(load_matrix<T>(data_path, n), graph_path, n, degree);
         }
 
+        // The file is mapped and copied into the table in parallel, no
+        // parsing. The copy is then checked like a parsed file would be:
+        // offsets rise from 0 to n_edges and every id is a node.
+        void load_binary_graph(const string& path) {
+            const MappedFile file(path);
+            GraphHeader header;
+            if (file.size < sizeof(header)) throw runtime_error("Invalid graph file!: " + path);
+            memcpy(&header, file.data(), sizeof(header));
+
+            if (memcmp(header.magic, graph_magic, sizeof(graph_magic)) != 0 || header.index_size != sizeof(int)) {
+                throw runtime_error("Invalid graph file!: " + path);
+            }
+            if (header.n_nodes != points.size()) {
+                throw runtime_error("Graph does not match the data size!: " + path);
+            }
+            const auto offsets_size = (header.n_nodes + 1) * sizeof(uint64_t);
+            if (file.size < sizeof(header) + offsets_size ||
+                header.n_edges > (file.size - sizeof(header) - offsets_size) / sizeof(int)) {
+                throw runtime_error("Invalid graph file!: " + path);
+            }
+
+            const auto offsets = reinterpret_cast<const uint64_t*>(file.data() + sizeof(header));
+            const auto indices = reinterpret_cast<const int*>(file.data() + sizeof(header) + offsets_size);
+            adjacency.offsets.resize(header.n_nodes + 1);
+            adjacency.indices.resize(header.n_edges);
+            parallel_copy(offsets, header.n_nodes + 1, adjacency.offsets.data());
+            parallel_copy(indices, header.n_edges, adjacency.indices.data());
+
+            const auto n_nodes = static_cast<long long>(header.n_nodes);
+            const auto& table_offsets = adjacency.offsets;
+            const auto& table_indices = adjacency.indices;
+            size_t n_invalid = 0;
+#pragma omp parallel for reduction(+ : n_invalid)
+            for (long long i = 0; i < n_nodes; ++i) {
+                if (table_offsets[i] > table_offsets[i + 1]) ++n_invalid;
+            }
+#pragma omp parallel for reduction(+ : n_invalid)
+            for (long long e = 0; e < header.n_edges; ++e) {
+                if (table_indices[e] < 0 || table_indices[e] >= n_nodes) ++n_invalid;
+            }
+            if (n_invalid > 0 || table_offsets.front() != 0 || table_offsets.back() != header.n_edges) {
+                adjacency = NeighborTable<>();
+                throw runtime_error("Invalid graph file!: " + path);
+            }
+        }
+
+        // adjacency lists "id,n1,n2,..." of nodes [begin, end)
+        string format_nodes(size_t begin, size_t end, bool as_pairs) const {
+            string text;
+            for (auto id = begin; id < end; ++id) {
+                if (as_pairs) {
+                    for (const auto neighbor_id : adjacency[id]) {
+                        append_uint(text, id);
+                        text += ',';
+                        append_uint(text, neighbor_id);
+                        text += '\n';
+                    }
+                    continue;
+                }
+                append_uint(text, id);
+                for (const auto neighbor_id : adjacency[id]) {
+                    text += ',';
+                    append_uint(text, neighbor_id);
+                }
+                text += '\n';
+            }
+            return text;
+        }
+
+        // Writes a binary graph (.bin), a csv file of adjacency lists, or a
+        // directory of i.csv files holding the edges of nodes
+        // [1000 i, 1000 (i + 1)) as pairs. Text is formatted in parallel.
         virtual void save(const string &save_path) {
+            // binary
+            if (is_binary(save_path)) {
+                ofstream ofs(save_path, ios::binary);
+                if (!ofs) throw runtime_error("Can't open file!: " + save_path);
+
+                GraphHeader header;
+                memset(&header, 0, sizeof(header));
+                memcpy(header.magic, graph_magic, sizeof(graph_magic));
+                header.version = 1;
+                header.index_size = sizeof(int);
+                header.n_nodes = size();
+                header.n_edges = n_edges();
+
+                const vector<uint64_t> offsets(adjacency.offsets.begin(), adjacency.offsets.end());
+                ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                ofs.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+                ofs.write(reinterpret_cast<const char*>(adjacency.indices.data()),
+                          adjacency.indices.size() * sizeof(int));
+                return;
+            }
+
+            constexpr size_t block_size = 1000;
+            const auto n_blocks = (size() + block_size - 1) / block_size;
+
             // csv
             if (is_csv(save_path)) {
                 ofstream ofs(save_path);
-                string line;
-                for (const auto &node : nodes) {
-                    line = to_string(node.data.id);
-                    for (const auto &neighbor_id : node.neighbors) {
-                        line += ',' + to_string(neighbor_id);
-                    }
-                    line += '\n';
-                    ofs << line;
-                }
+                if (!ofs) throw runtime_error("Can't open file!: " + save_path);
+                write_blocks(ofs, n_blocks, [&](size_t block) {
+                    return format_nodes(block * block_size, min(size(), (block + 1) * block_size), false);
+                });
                 return;
             }
 
             // dir
-            vector<string> lines(static_cast<unsigned long>(ceil(nodes.size() / 1000.0)));
-            for (const auto& node : nodes) {
-                const size_t line_i = node.data.id / 1000;
-                for (const auto& neighbor_id : node.neighbors) {
-                    lines[line_i] += to_string(node.data.id) + "," +
-                                     to_string(neighbor_id) + "\n";
-                }
-            }
-
-            for (int i = 0; i < lines.size(); i++) {
+            vector<char> written(n_blocks);
+#pragma omp parallel for schedule(dynamic, 1)
+            for (int i = 0; i < n_blocks; i++) {
                 const string path = save_path + "/" + to_string(i) + ".csv";
                 ofstream ofs(path);
-                ofs << lines[i];
+                ofs << format_nodes(i * block_size, min(size(), (i + 1) * block_size), true);
+                written[i] = static_cast<bool>(ofs);
+            }
+            for (size_t i = 0; i < n_blocks; i++) {
+                if (!written[i]) throw runtime_error("Can't write file!: " + save_path + "/" + to_string(i) + ".csv");
             }
         }
 
-        auto self_range_search(int query_id, float range) const {
-            const auto& query_node = nodes[query_id];
+        // Breadth-first search from query_id that only expands nodes within
+        // range of the query; appends those nodes (query excluded) to result in
+        // the order they are found, and the number of distances computed to
+        // *n_distances if given.
+        void self_range_search(int query_id, double range, VisitedList& visited,
+                               vector<int>& result, size_t* n_distances = nullptr) const {
+            dispatch_dim(points.dim, [&](auto fixed_dim) {
+                const auto query = points.row_data(query_id);
+                const auto radius = Metric::radius(range);
+                const auto threshold = radius * radius;
+                const auto first = result.size();
+
+                visited.reset(size());
+                visited.visit(query_id);
+                // result doubles as the queue; the query is expanded first
+                result.emplace_back(query_id);
+                size_t n_visited = 0;
+                for (auto head = first; head < result.size(); ++head) {
+                    for (const auto neighbor_id : adjacency[result[head]]) {
+                        if (!visited.visit(neighbor_id)) continue;
+
+                        ++n_visited;
+                        const auto dist = squared_l2(query, points.row_data(neighbor_id), points.dim, fixed_dim);
+                        if (dist < threshold) result.emplace_back(neighbor_id);
+                    }
+                }
+                result.erase(result.begin() + first);
+                if (n_distances) *n_distances += n_visited;
+            });
+        }
 
-            unordered_map<int, bool> added;
-            added[query_id] = true;
+        auto self_range_search(int query_id, double range) const {
+            static thread_local VisitedList visited;
+            vector<int> result;
+            self_range_search(query_id, range, visited, result);
+            return result;
+        }
 
-            unordered_map<int, bool> checked;
+        vector<int> range_search(int point_id, double range) const override {
+            auto result = self_range_search(point_id, range);
+            sort(result.begin(), result.end());
+            return result;
+        }
 
+        vector<int> counted_range_search(int point_id, double range, size_t& n_distances) const override {
+            static thread_local VisitedList visited;
             vector<int> result;
-            result.emplace_back(query_id);
+            self_range_search(point_id, range, visited, result, &n_distances);
+            sort(result.begin(), result.end());
+            return result;
+        }
 
-            while (true) {
-                int first_unchecked_id = 0;
-                bool is_over = true;
-                for (const auto& e : result) {
-                    if (checked[e]) continue;
-                    checked[e] = true;
-                    first_unchecked_id = e;
-                    is_over = false;
-                    break;
+        // self_range_search for every node in parallel, with one VisitedList
+        // per thread; lists are sorted and ready for DBSCAN::fit
+        NeighborTable<> self_range_search_all(double range) const {
+            vector<VisitedList> visited(omp_get_max_threads());
+            const auto search = [&](int id, vector<int>& out, size_t* n_distances) {
+                const auto first = out.size();
+                self_range_search(id, range, visited[omp_get_thread_num()], out, n_distances);
+                sort(out.begin() + first, out.end());
+            };
+            if (!stats) {
+                return build_neighbor_table(size(), [&](int id, vector<int>& out) { search(id, out, nullptr); });
+            }
+            return build_measured_neighbor_table(
+                    size(), *stats, "graph_search",
+                    [&](int id, vector<int>& out, size_t& n_distances) { search(id, out, &n_distances); });
+        }
+    };
+
+    using GraphIndex = BasicGraphIndex<double>;
+
+    // Collects edges from any number of producers and freezes them into a
+    // GraphIndex; deduplication and the optional reverse edges are handled in
+    // one parallel batch step by build_adjacency.
+    struct GraphBuilder {
+        size_t n;
+        vector<vector<pair<int, int>>> edge_blocks;
+
+        GraphBuilder(size_t n) : n(n) {}
+
+        // thread-safe; hand over edges in blocks rather than one at a time
+        void add_edges(vector<pair<int, int>> edges) {
+#pragma omp critical(graph_builder)
+            edge_blocks.emplace_back(move(edges));
+        }
+
+        template <typename T>
+        BasicGraphIndex<T> build(const Matrix<T>& points, bool bidirectional = false) const {
+            auto adjacency = build_adjacency(
+                    n, edge_blocks.size(),
+                    [&](int block, auto emit) {
+                        for (const auto& edge : edge_blocks[block]) emit(edge.first, edge.second);
+                    },
+                    bidirectional);
+            return BasicGraphIndex<T>(points, move(adjacency));
+        }
+    };
+
+    struct NNDescentParams {
+        int degree = 20;             // neighbors kept per node
+        int max_iterations = 12;
+        double sample_rate = 0.5;    // share of degree joined per node and round
+        double termination = 0.001;  // stop once fewer than this share of entries change
+        bool bidirectional = true;   // also link every node from its neighbors
+        unsigned seed = 0;
+    };
+
+    // Approximate kNN graph by NN-Descent (Dong et al., WWW 2011): every node
+    // starts with random neighbors, and each round compares the neighbors of
+    // a node with each other, keeping the closest `degree` ones per node.
+    // Rounds run in parallel; neighbor lists are max-heaps updated under
+    // striped locks.
+    template <typename T>
+    BasicGraphIndex<T> build_nn_descent_graph(const Matrix<T>& points,
+                                              const NNDescentParams& params = NNDescentParams()) {
+        struct Neighbor {
+            double dist;
+            int id;
+            bool is_new;
+
+            bool operator<(const Neighbor& o) const { return dist < o.dist; }
+        };
+
+        const auto n = points.size();
+        const auto k = min<size_t>(max(params.degree, 0), n > 0 ? n - 1 : 0);
+        if (k == 0) return GraphBuilder(n).build(points);
+
+        const auto sample_size = max<size_t>(1, static_cast<size_t>(params.sample_rate * k));
+        const auto distance = [&](int a, int b) {
+            return squared_l2(points.row_data(a), points.row_data(b), points.dim);
+        };
+
+        vector<Neighbor> heaps(n * k);
+        vector<mutex> locks(min<size_t>(n, 1 << 16));
+        const auto lock_of = [&](int id) -> mutex& { return locks[id % locks.size()]; };
+
+#pragma omp parallel for
+        for (int v = 0; v < n; ++v) {
+            mt19937 engine(params.seed + v);
+            uniform_int_distribution<int> random_id(0, static_cast<int>(n) - 1);
+            const auto heap = heaps.begin() + v * k;
+            for (size_t i = 0; i < k;) {
+                const auto id = random_id(engine);
+                if (id == v || any_of(heap, heap + i, [&](const Neighbor& e) { return e.id == id; }))
+                    continue;
+                heap[i++] = {distance(v, id), id, true};
+            }
+            make_heap(heap, heap + k);
+        }
+
+        // 1 if id was inserted into the list of v
+        const auto update = [&](int v, int id, double dist) {
+            if (v == id) return 0;
+            lock_guard<mutex> lock(lock_of(v));
+            const auto heap = heaps.begin() + v * k;
+            if (dist >= heap[0].dist) return 0;
+            if (any_of(heap, heap + k, [&](const Neighbor& e) { return e.id == id; })) return 0;
+            pop_heap(heap, heap + k);
+            heap[k - 1] = {dist, id, true};
+            push_heap(heap, heap + k);
+            return 1;
+        };
+
+        for (int iteration = 0; iteration < params.max_iterations; ++iteration) {
+            vector<vector<int>> new_lists(n), old_lists(n);
+#pragma omp parallel for
+            for (int v = 0; v < n; ++v) {
+                for (auto it = heaps.begin() + v * k; it != heaps.begin() + (v + 1) * k; ++it) {
+                    if (!it->is_new) old_lists[v].emplace_back(it->id);
+                    else if (new_lists[v].size() < sample_size) {
+                        new_lists[v].emplace_back(it->id);
+                        it->is_new = false;
+                    }
+                }
+            }
+
+            // reverse neighbors, sampled to the same size
+            vector<vector<int>> reverse_new(n), reverse_old(n);
+#pragma omp parallel for
+            for (int v = 0; v < n; ++v) {
+                const auto add_reverse = [&](vector<vector<int>>& reverse, int u) {
+                    lock_guard<mutex> lock(lock_of(u));
+                    if (reverse[u].size() < sample_size) reverse[u].emplace_back(v);
+                };
+                for (const auto u : new_lists[v]) add_reverse(reverse_new, u);
+                for (const auto u : old_lists[v]) add_reverse(reverse_old, u);
+            }
+
+#pragma omp parallel for
+            for (int v = 0; v < n; ++v) {
+                for (auto lists : {make_pair(&new_lists[v], &reverse_new[v]),
+                                   make_pair(&old_lists[v], &reverse_old[v])}) {
+                    auto& list = *lists.first;
+                    list.insert(list.end(), lists.second->begin(), lists.second->end());
+                    sort(list.begin(), list.end());
+                    list.erase(unique(list.begin(), list.end()), list.end());
                 }
+            }
 
-                if (is_over) {
-                    result.erase(result.begin());
-                    return result;
+            // local join: neighbors of v are likely neighbors of each other
+            size_t n_updates = 0;
+#pragma omp parallel for schedule(dynamic, 64) reduction(+ : n_updates)
+            for (int v = 0; v < n; ++v) {
+                const auto& new_list = new_lists[v];
+                const auto& old_list = old_lists[v];
+                for (size_t i = 0; i < new_list.size(); ++i) {
+                    for (size_t j = i + 1; j < new_list.size(); ++j) {
+                        const auto dist = distance(new_list[i], new_list[j]);
+                        n_updates += update(new_list[i], new_list[j], dist);
+                        n_updates += update(new_list[j], new_list[i], dist);
+                    }
+                    for (const auto old_id : old_list) {
+                        if (old_id == new_list[i]) continue;
+                        const auto dist = distance(new_list[i], old_id);
+                        n_updates += update(new_list[i], old_id, dist);
+                        n_updates += update(old_id, new_list[i], dist);
+                    }
                 }
+            }
+
+            if (n_updates < params.termination * n * k) break;
+        }
+
+        GraphBuilder builder(n);
+        constexpr size_t block_size = 4096;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int block = 0; block < (n + block_size - 1) / block_size; ++block) {
+            vector<pair<int, int>> edges;
+            for (auto v = block * block_size; v < min(n, (block + 1) * block_size); ++v) {
+                for (size_t i = 0; i < k; ++i) edges.emplace_back(v, heaps[v * k + i].id);
+            }
+            builder.add_edges(move(edges));
+        }
+        return builder.build(points, params.bidirectional);
+    }
+
+    // Share of the exact eps-neighbor pairs that an approximate table, e.g.
+    // GraphIndex::self_range_search_all, also found. Rows must be sorted.
+    template <typename Approximate, typename Exact>
+    double eps_neighborhood_recall(const Approximate& approximate, const Exact& exact) {
+        size_t n_found = 0, n_true = 0;
+#pragma omp parallel for reduction(+ : n_found, n_true)
+        for (int id = 0; id < exact.size(); ++id) {
+            const auto found = approximate[id];
+            const auto truth = exact[id];
+            auto it = found.begin();
+            for (const auto neighbor_id : truth) {
+                while (it != found.end() && *it < neighbor_id) ++it;
+                if (it != found.end() && *it == neighbor_id) ++n_found;
+            }
+            n_true += truth.size();
+        }
+        return n_true == 0 ? 1.0 : static_cast<double>(n_found) / n_true;
+    }
+
+    template <typename T>
+    struct BasicBruteForceIndex : public RangeIndex {
+        Matrix<T> points;
+
+        BasicBruteForceIndex(const Matrix<T>& points) : points(points) {}
 
-                const auto& first_unchecked_node = nodes[first_unchecked_id];
-                for (const auto& neighbor_id : first_unchecked_node.neighbors) {
-                    if (added[neighbor_id]) continue;
-                    added[neighbor_id] = true;
+        vector<int> range_search(int point_id, double range) const override {
+            // rows per call of the tile kernel; the distances of one tile stay in L1
+            constexpr size_t tile_size = 256;
+            const auto tile = squared_l2_tile_kernel<T>();
+            const auto threshold = range * range;
+            const auto query = points.row_data(point_id);
 
-                    const auto& neighbor = nodes[neighbor_id];
-                    const auto dist = euclidean_distance(query_node.data, neighbor.data);
-                    if (dist < range) result.emplace_back(neighbor_id);
+            vector<int> result;
+            T dists[tile_size];
+            for (size_t begin = 0; begin < points.size(); begin += tile_size) {
+                const auto n_rows = min(tile_size, points.size() - begin);
+                // short rows are faster unrolled than through the SIMD tile kernel
+                dispatch_dim(points.dim, [&](auto fixed_dim) {
+                    if (fixed_dim == 0 || fixed_dim > 4) {
+                        tile(query, points.row_data(begin), n_rows, points.dim, dists);
+                        return;
+                    }
+                    for (size_t i = 0; i < n_rows; ++i)
+                        dists[i] = squared_l2(query, points.row_data(begin + i), points.dim, fixed_dim);
+                });
+                for (size_t i = 0; i < n_rows; ++i) {
+                    if (dists[i] < threshold && begin + i != point_id)
+                        result.emplace_back(begin + i);
                 }
             }
+            return result;
+        }
+
+        vector<int> counted_range_search(int point_id, double range, size_t& n_distances) const override {
+            n_distances += points.size();
+            return range_search(point_id, range);
         }
     };
 
-    struct DBSCAN {
-        double eps;
-        int minpts;
-        Database database;
-        Clusters clusters;
+    using BruteForceIndex = BasicBruteForceIndex<double>;
 
-        DBSCAN(double eps, int minpts) : eps(eps), minpts(minpts) {}
+    // Uniform grid of hypercube cells with side `cell_size` (normally eps).
+    // Every eps-neighbor of a point lies in one of the 3^d cells around the
+    // point's own cell, so a range search never has to scan the whole database.
+    // Cells are keyed by a hash of their integer coordinates; colliding cells
+    // only add candidates, which are filtered by the exact distance check.
+    // A cell_size that is not positive puts every point in a single cell,
+    // which degrades to a brute-force scan instead of dividing by zero.
+    template <typename T>
+    struct BasicGridIndex : public RangeIndex {
+        Matrix<T> points;
+        double cell_size;
+        size_t dim;
+        unordered_map<size_t, vector<int>> cells;
 
-        auto scan_eps_neighbors(int point_id) {
-            const auto& query = database[point_id];
-            vector<int> result;
-            for (const auto data : database) {
-                if (point_id == data.id) continue;
+        BasicGridIndex(const Matrix<T>& points, double cell_size) :
+                points(points), cell_size(cell_size), dim(points.dim) {
+            for (size_t id = 0; id < points.size(); ++id) insert(id);
+        }
+
+        // insert and remove keep the grid in sync with a changing point set;
+        // an inserted id must already be a row of `points`
+        void insert(int id) {
+            cells[cell_hash(cell_of(points[id]))].emplace_back(id);
+        }
+
+        void remove(int id) {
+            const auto it = cells.find(cell_hash(cell_of(points[id])));
+            if (it == cells.end()) return;
+            auto& ids = it->second;
+            const auto position = find(ids.begin(), ids.end(), id);
+            if (position == ids.end()) return;
+            *position = ids.back();
+            ids.pop_back();
+            if (ids.empty()) cells.erase(it);
+        }
 
-                const auto dist = euclidean_distance(query, data);
-                if (dist < eps)
-                    result.emplace_back(data.id);
+        vector<long long> cell_of(const Row<T>& point) const {
+            vector<long long> cell(dim);
+            if (!(cell_size > 0)) return cell;
+            for (size_t d = 0; d < dim; ++d) {
+                cell[d] = static_cast<long long>(floor(point[d] / cell_size));
             }
-            return result;
+            return cell;
         }
 
-        void assign(Point& point, int cluster_id) {
-            point.cluster_id = cluster_id;
-            clusters[cluster_id].emplace_back(point.id);
+        static size_t cell_hash(const vector<long long>& cell) {
+            size_t hash = 0;
+            for (const auto c : cell) {
+                hash ^= static_cast<size_t>(c) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+
+        vector<int> range_search(int point_id, double range) const override {
+            size_t n_distances = 0;
+            return counted_range_search(point_id, range, n_distances);
+        }
+
+        vector<int> counted_range_search(int point_id, double range, size_t& n_distances) const override {
+            return dispatch_dim(dim, [&](auto fixed_dim) {
+                return range_search(point_id, range, n_distances, fixed_dim);
+            });
         }
 
-        void expand_cluster(Point& point, vector<int> neighbors, int cluster_id,
-                            const vector<vector<int>>& eps_neighbors_list,
-                            unordered_map<int, bool>& visited) {
-            // assign clusters
-            assign(point, cluster_id);
+        template <size_t Dim>
+        vector<int> range_search(int point_id, double range, size_t& n_distances,
+                                 FixedDim<Dim> fixed_dim) const {
+            // no point is strictly closer than a range <= 0
+            if (!(range > 0)) return {};
+            const auto query = points[point_id];
+            const auto origin = cell_of(query);
+            const auto reach = cell_size > 0 ? static_cast<long long>(ceil(range / cell_size)) : 0;
+            const auto threshold = range * range;
 
-            for (int i = 0; i < neighbors.size(); ++i) {
-                const auto neighbor_id = neighbors[i];
-                auto& neighbor = database[neighbor_id];
-                if (!visited[neighbor_id]) {
-                    visited[neighbor_id] = true;
+            vector<int> result;
+            vector<long long> offset(dim, -reach), cell(dim);
+            while (true) {
+                for (size_t d = 0; d < dim; ++d) cell[d] = origin[d] + offset[d];
 
-                    const auto& neighbor_neighbors = eps_neighbors_list[neighbor_id];
-                    if (neighbor_neighbors.size() >= minpts) {
-                        for (const auto neighbor_neighbor_id : neighbor_neighbors)
-                            neighbors.emplace_back(neighbor_neighbor_id);
+                const auto it = cells.find(cell_hash(cell));
+                if (it != cells.end()) {
+                    n_distances += it->second.size();
+                    for (const auto id : it->second) {
+                        if (id == point_id) continue;
+                        const auto dist = squared_l2(query.x, points.row_data(id), dim, fixed_dim);
+                        if (dist < threshold) result.emplace_back(id);
                     }
                 }
-                if (neighbor.cluster_id < 0) {
-                    assign(neighbor, cluster_id);
+
+                // advance offset through {-reach, ..., reach}^d
+                size_t d = 0;
+                for (; d < dim; ++d) {
+                    if (++offset[d] <= reach) break;
+                    offset[d] = -reach;
                 }
+                if (d == dim) break;
             }
+
+            // hash collisions can yield the same cell twice
+            sort(result.begin(), result.end());
+            result.erase(unique(result.begin(), result.end()), result.end());
+            return result;
         }
+    };
 
-        // cite from https://ja.wikipedia.org/wiki/DBSCAN
-        void fit(const Dataset<>& dataset,
-                 vector<vector<int>> eps_neighbors_list = vector<vector<int>>()) {
-            database = convert(dataset);
+    using GridIndex = BasicGridIndex<double>;
 
-            // calculate eps neighbors if eps_neighbors_list is empty
-            if (eps_neighbors_list.empty()) {
-                eps_neighbors_list.resize(database.size());
-#pragma omp parallel for simd
-                for (int id = 0; id < database.size(); ++id)
-                    eps_neighbors_list[id] = scan_eps_neighbors(id);
-            }
+    // KD-tree over the points of a Database. Each inner node splits its range
+    // of `ids` at the median of the dimension with the largest spread, so
+    // queries only descend into halves whose split plane is within range.
+    template <typename T>
+    struct BasicKDTree : public RangeIndex {
+        struct KDNode {
+            int begin, end;  // range of ids
+            int left = -1, right = -1;
+            size_t split_dim = 0;
+            double split_value = 0;
+
+            bool is_leaf() const { return left < 0; }
+        };
 
-            // clustering
-            int cluster_id = -1;
-            unordered_map<int, bool> visited;
+        Matrix<T> points;
+        size_t leaf_size;
+        vector<int> ids;
+        vector<KDNode> kd_nodes;
+
+        BasicKDTree(const Matrix<T>& points, size_t leaf_size = 16) :
+                points(points), leaf_size(leaf_size), ids(points.size()) {
+            iota(ids.begin(), ids.end(), 0);
+            if (!ids.empty()) build(0, static_cast<int>(ids.size()));
+        }
 
-            for (auto& point : database) {
-                if (visited[point.id]) continue;
-                visited[point.id] = true;
+        int build(int begin, int end) {
+            const auto node_id = static_cast<int>(kd_nodes.size());
+            kd_nodes.push_back({begin, end});
+            if (end - begin <= leaf_size) return node_id;
 
-                const auto& eps_neighbors = eps_neighbors_list[point.id];
-                if (eps_neighbors.size() < minpts)
-                    point.cluster_id = -1; // noise
-                else {
-                    ++cluster_id;
-                    clusters.resize(cluster_id + 1);
-                    expand_cluster(point, eps_neighbors, cluster_id,
-                                   eps_neighbors_list, visited);
+            const auto dim = points.dim;
+            const auto coord = [&](int id, size_t d) -> double { return points.row_data(id)[d]; };
+            size_t split_dim = 0;
+            double max_spread = -1;
+            for (size_t d = 0; d < dim; ++d) {
+                double lo = coord(ids[begin], d), hi = lo;
+                for (int i = begin + 1; i < end; ++i) {
+                    lo = min(lo, coord(ids[i], d));
+                    hi = max(hi, coord(ids[i], d));
+                }
+                if (hi - lo > max_spread) {
+                    max_spread = hi - lo;
+                    split_dim = d;
                 }
             }
-        }
 
-        void fit(string data_path, int n = -1) {
-            const auto dataset = load_data(data_path, n);
-            fit(dataset);
+            const auto mid = begin + (end - begin) / 2;
+            nth_element(ids.begin() + begin, ids.begin() + mid, ids.begin() + end,
+                        [&](int a, int b) { return coord(a, split_dim) < coord(b, split_dim); });
+
+            kd_nodes[node_id].split_dim = split_dim;
+            kd_nodes[node_id].split_value = coord(ids[mid], split_dim);
+            const auto left = build(begin, mid);
+            const auto right = build(mid, end);
+            kd_nodes[node_id].left = left;
+            kd_nodes[node_id].right = right;
+            return node_id;
         }
 
-        void save(string save_path) {
-            ofstream ofs(save_path);
-            ofs << "cluster_id" << endl;
-            for (const auto& point : database) {
-                ofs << point.cluster_id << endl;
+        template <size_t Dim>
+        void search(int node_id, const Row<T>& query, double range, vector<int>& result,
+                    size_t& n_distances, FixedDim<Dim> fixed_dim) const {
+            const auto& node = kd_nodes[node_id];
+            if (node.is_leaf()) {
+                n_distances += node.end - node.begin;
+                for (int i = node.begin; i < node.end; ++i) {
+                    const auto id = ids[i];
+                    if (id == query.id) continue;
+                    const auto dist = squared_l2(query.x, points.row_data(id), points.dim, fixed_dim);
+                    if (dist < range * range) result.emplace_back(id);
+                }
+                return;
             }
+
+            // left holds values <= split_value, right holds values >= split_value
+            const auto diff = query[node.split_dim] - node.split_value;
+            if (diff < range) search(node.left, query, range, result, n_distances, fixed_dim);
+            if (-diff < range) search(node.right, query, range, result, n_distances, fixed_dim);
+        }
+
+        vector<int> range_search(int point_id, double range) const override {
+            size_t n_distances = 0;
+            return counted_range_search(point_id, range, n_distances);
+        }
+
+        vector<int> counted_range_search(int point_id, double range, size_t& n_distances) const override {
+            vector<int> result;
+            if (!kd_nodes.empty()) {
+                dispatch_dim(points.dim, [&](auto fixed_dim) {
+                    search(0, points[point_id], range, result, n_distances, fixed_dim);
+                });
+            }
+            sort(result.begin(), result.end());
+            return result;
+        }
+    };
+
+    using KDTree = BasicKDTree<double>;
+
+    // Ball tree over the points of a Database. Every node keeps the centroid
+    // of its points and the radius enclosing them, which still prunes well in
+    // dimensions where the axis-aligned splits of a KD-tree stop helping.
+    template <typename T>
+    struct BasicBallTree : public RangeIndex {
+        struct BallNode {
+            int begin, end;  // range of ids
+            int left = -1, right = -1;
+            double radius = 0;
+
+            bool is_leaf() const { return left < 0; }
+        };
+
+        Matrix<T> points;
+        size_t dim;
+        size_t leaf_size;
+        vector<int> ids;
+        vector<BallNode> ball_nodes;
+        vector<T> centers;  // dim values per node
+
+        BasicBallTree(const Matrix<T>& points, size_t leaf_size = 16) :
+                points(points), dim(points.dim), leaf_size(leaf_size), ids(points.size()) {
+            iota(ids.begin(), ids.end(), 0);
+            if (!ids.empty()) build(0, static_cast<int>(ids.size()));
+        }
+
+        double distance_to_center(const Row<T>& point, int node_id) const {
+            return sqrt(squared_l2(point.x, centers.data() + node_id * dim, dim));
+        }
+
+        int build(int begin, int end) {
+            const auto coord = [&](int id, size_t d) -> double { return points.row_data(id)[d]; };
+            const auto node_id = static_cast<int>(ball_nodes.size());
+            ball_nodes.push_back({begin, end});
+
+            centers.resize(centers.size() + dim, 0);
+            const auto center = centers.begin() + node_id * dim;
+            for (int i = begin; i < end; ++i) {
+                for (size_t d = 0; d < dim; ++d) center[d] += coord(ids[i], d);
+            }
+            for (size_t d = 0; d < dim; ++d) center[d] /= (end - begin);
+
+            double radius = 0;
+            for (int i = begin; i < end; ++i) {
+                radius = max(radius, distance_to_center(points[ids[i]], node_id));
+            }
+            ball_nodes[node_id].radius = radius;
+            if (end - begin <= leaf_size) return node_id;
+
+            // split along the dimension with the largest spread
+            size_t split_dim = 0;
+            double max_spread = -1;
+            for (size_t d = 0; d < dim; ++d) {
+                double lo = coord(ids[begin], d), hi = lo;
+                for (int i = begin + 1; i < end; ++i) {
+                    lo = min(lo, coord(ids[i], d));
+                    hi = max(hi, coord(ids[i], d));
+                }
+                if (hi - lo > max_spread) {
+                    max_spread = hi - lo;
+                    split_dim = d;
+                }
+            }
+
+            const auto mid = begin + (end - begin) / 2;
+            nth_element(ids.begin() + begin, ids.begin() + mid, ids.begin() + end,
+                        [&](int a, int b) { return coord(a, split_dim) < coord(b, split_dim); });
+
+            const auto left = build(begin, mid);
+            const auto right = build(mid, end);
+            ball_nodes[node_id].left = left;
+            ball_nodes[node_id].right = right;
+            return node_id;
+        }
+
+        void search(int node_id, const Row<T>& query, double range, vector<int>& result,
+                    size_t& n_distances) const {
+            const auto& node = ball_nodes[node_id];
+            ++n_distances;
+            if (distance_to_center(query, node_id) - node.radius >= range) return;
+
+            if (node.is_leaf()) {
+                n_distances += node.end - node.begin;
+                for (int i = node.begin; i < node.end; ++i) {
+                    const auto id = ids[i];
+                    if (id == query.id) continue;
+                    const auto dist = squared_l2(query.x, points.row_data(id), points.dim);
+                    if (dist < range * range) result.emplace_back(id);
+                }
+                return;
+            }
+
+            search(node.left, query, range, result, n_distances);
+            search(node.right, query, range, result, n_distances);
+        }
+
+        vector<int> range_search(int point_id, double range) const override {
+            size_t n_distances = 0;
+            return counted_range_search(point_id, range, n_distances);
+        }
+
+        vector<int> counted_range_search(int point_id, double range, size_t& n_distances) const override {
+            vector<int> result;
+            if (!ball_nodes.empty()) search(0, points[point_id], range, result, n_distances);
+            sort(result.begin(), result.end());
+            return result;
+        }
+    };
+
+    using BallTree = BasicBallTree<double>;
+
+    // Range searches over a PivotTable: a scan of all points like
+    // BasicBruteForceIndex, minus the candidates the pivots rule out. The
+    // query's own pivot distances are already in the table.
+    template <typename T>
+    struct BasicPivotIndex : public RangeIndex {
+        PivotTable<T> table;
+        mutable atomic<size_t> pruned{0};
+
+        BasicPivotIndex(const Matrix<T>& points, size_t n_pivots = 16) : table(points, n_pivots) {}
+
+        vector<int> range_search(int point_id, double range) const override {
+            size_t n_distances = 0;
+            return counted_range_search(point_id, range, n_distances);
+        }
+
+        vector<int> counted_range_search(int point_id, double range, size_t& n_distances) const override {
+            vector<int> result;
+            PivotCounts counts;
+            table.range_search(table.points.row_data(point_id), table.pivot_distances(point_id), range,
+                               result, counts, point_id);
+            n_distances += counts.n_evaluated;
+            pruned.fetch_add(counts.n_pruned, memory_order_relaxed);
+            return result;
+        }
+
+        size_t n_pruned() const override { return pruned.load(memory_order_relaxed); }
+    };
+
+    using PivotIndex = BasicPivotIndex<double>;
+
+    // A full scan like BasicBruteForceIndex that reads the uint8 codes of a
+    // QuantizedMatrix instead of the rows: a candidate is dropped when its
+    // lower bound reaches the range, taken when its upper bound stays below,
+    // and only the rest are compared on the exact rows, so the result equals
+    // brute force. n_distances counts the exact comparisons and n_pruned
+    // the dropped candidates.
+    template <typename T>
+    struct BasicQuantizedIndex : public RangeIndex {
+        Matrix<T> points;
+        QuantizedMatrix<T> quantized;
+        mutable atomic<size_t> pruned{0};
+
+        BasicQuantizedIndex(const Matrix<T>& points) : points(points), quantized(points) {}
+
+        vector<int> range_search(int point_id, double range) const override {
+            size_t n_distances = 0;
+            return counted_range_search(point_id, range, n_distances);
+        }
+
+        vector<int> counted_range_search(int point_id, double range, size_t& n_distances) const override {
+            // the bounds are widened by the rounding of T, so that a pair is
+            // only decided on them where the exact comparison would agree
+            const auto slack = sqrt(numeric_limits<T>::epsilon());
+            const auto query = quantized.row_codes(point_id);
+            const auto query_error = quantized.errors[point_id];
+            const auto step2 = quantized.step * quantized.step;
+            const auto threshold = range * range;
+
+            vector<int> result;
+            size_t n_pruned = 0;
+            for (int id = 0; id < quantized.size(); ++id) {
+                if (id == point_id) continue;
+                const auto code_dist = step2 * squared_l2_u8(query, quantized.row_codes(id), quantized.dim);
+                const auto error = query_error + quantized.errors[id];
+                const auto far = range + error;
+                if (code_dist >= far * far * (1 + slack)) {
+                    ++n_pruned;
+                    continue;
+                }
+                const auto near = range - error;
+                if (near > 0 && code_dist < near * near * (1 - slack)) {
+                    result.emplace_back(id);
+                    continue;
+                }
+                ++n_distances;
+                if (squared_l2(points.row_data(point_id), points.row_data(id), points.dim) < threshold)
+                    result.emplace_back(id);
+            }
+            pruned.fetch_add(n_pruned, memory_order_relaxed);
+            return result;
+        }
+
+        size_t n_pruned() const override { return pruned.load(memory_order_relaxed); }
+    };
+
+    using QuantizedIndex = BasicQuantizedIndex<double>;
+
+    // nn_descent is approximate: eps-neighborhoods are found by traversing an
+    // NN-Descent graph, so some neighbors may be missed
+    enum class IndexType { automatic, brute_force, grid, kd_tree, ball_tree, nn_descent, pivot, quantized };
+
+    // builds the index fit uses for its neighbor phase;
+    // automatic picks by dimension: grid, then KD-tree, then ball tree
+    template <typename T>
+    unique_ptr<RangeIndex> make_index(IndexType type, const Matrix<T>& points, double eps,
+                                      const NNDescentParams& graph_params = NNDescentParams()) {
+        const auto dim = points.dim;
+        if (type == IndexType::automatic) {
+            if (dim <= 3) type = IndexType::grid;
+            else if (dim <= 16) type = IndexType::kd_tree;
+            else if (dim <= 64) type = IndexType::ball_tree;
+            else type = IndexType::brute_force;
+        }
+
+        switch (type) {
+            case IndexType::grid: return unique_ptr<RangeIndex>(new BasicGridIndex<T>(points, eps));
+            case IndexType::kd_tree: return unique_ptr<RangeIndex>(new BasicKDTree<T>(points));
+            case IndexType::ball_tree: return unique_ptr<RangeIndex>(new BasicBallTree<T>(points));
+            case IndexType::pivot: return unique_ptr<RangeIndex>(new BasicPivotIndex<T>(points));
+            case IndexType::quantized: return unique_ptr<RangeIndex>(new BasicQuantizedIndex<T>(points));
+            case IndexType::nn_descent:
+                return unique_ptr<RangeIndex>(new BasicGraphIndex<T>(build_nn_descent_graph(points, graph_params)));
+            default: return unique_ptr<RangeIndex>(new BasicBruteForceIndex<T>(points));
+        }
+    }
+
+    // range search around every point in parallel, packed into a NeighborTable
+    NeighborTable<> compute_eps_neighbors(const RangeIndex& index, size_t n, double eps,
+                                          FitStats* stats = nullptr) {
+        if (!stats) {
+            return build_neighbor_table(n, [&](int id, vector<int>& out) {
+                const auto neighbors = index.range_search(id, eps);
+                out.insert(out.end(), neighbors.begin(), neighbors.end());
+            });
+        }
+        const auto n_pruned = index.n_pruned();
+        auto table = build_measured_neighbor_table(n, *stats, "neighbors",
+                                                   [&](int id, vector<int>& out, size_t& n_distances) {
+            const auto neighbors = index.counted_range_search(id, eps, n_distances);
+            out.insert(out.end(), neighbors.begin(), neighbors.end());
+        });
+        stats->n_pruned += index.n_pruned() - n_pruned;
+        return table;
+    }
+
+    // Lock-free union-find over point ids. A root is always the smallest id of
+    // its set, so the final sets and roots do not depend on the order in which
+    // threads perform the unions.
+    struct ConcurrentUnionFind {
+        vector<atomic<int>> parent;
+
+        ConcurrentUnionFind(size_t n) : parent(n) {
+#pragma omp parallel for
+            for (int i = 0; i < n; ++i) parent[i].store(i, memory_order_relaxed);
+        }
+
+        int find(int x) {
+            while (true) {
+                auto p = parent[x].load();
+                if (p == x) return x;
+                const auto grandparent = parent[p].load();
+                // path halving; losing the race only leaves the path longer
+                if (grandparent != p) parent[x].compare_exchange_weak(p, grandparent);
+                x = grandparent;
+            }
+        }
+
+        void unite(int a, int b) {
+            while (true) {
+                a = find(a);
+                b = find(b);
+                if (a == b) return;
+                if (a > b) swap(a, b);
+                auto expected = b;
+                if (parent[b].compare_exchange_strong(expected, a)) return;
+            }
+        }
+    };
+
+    void atomic_fetch_min(atomic<int>& target, int value) {
+        auto current = target.load(memory_order_relaxed);
+        while (value < current &&
+               !target.compare_exchange_weak(current, value, memory_order_relaxed)) {}
+    }
+
+    // Labels points from their eps-neighborhoods, where `neighbors_of(id)`
+    // returns the neighbor ids of `id` as a range. Core points (at least minpts
+    // neighbors) are joined in parallel with a ConcurrentUnionFind, and every
+    // border point takes the smallest cluster id among the core points listing
+    // it. Clusters are numbered by their smallest core point, the same order a
+    // serial scan over the points creates them in, whatever the thread count.
+    template <typename NeighborsOf>
+    vector<int> label_clusters(size_t n, int minpts, NeighborsOf neighbors_of) {
+        vector<char> is_core(n);
+#pragma omp parallel for
+        for (int id = 0; id < n; ++id) is_core[id] = neighbors_of(id).size() >= minpts;
+
+        ConcurrentUnionFind union_find(n);
+#pragma omp parallel for schedule(dynamic, 64)
+        for (int id = 0; id < n; ++id) {
+            if (!is_core[id]) continue;
+            for (const auto neighbor_id : neighbors_of(id)) {
+                if (is_core[neighbor_id]) union_find.unite(id, neighbor_id);
+            }
+        }
+
+        vector<int> root_labels(n, -1);
+        int n_clusters = 0;
+        for (int id = 0; id < n; ++id) {
+            if (is_core[id] && union_find.parent[id].load(memory_order_relaxed) == id)
+                root_labels[id] = n_clusters++;
+        }
+
+        vector<int> labels(n, -1);
+        vector<atomic<int>> border_labels(n);
+#pragma omp parallel for
+        for (int id = 0; id < n; ++id) {
+            if (is_core[id]) labels[id] = root_labels[union_find.find(id)];
+            border_labels[id].store(numeric_limits<int>::max(), memory_order_relaxed);
+        }
+
+#pragma omp parallel for schedule(dynamic, 64)
+        for (int id = 0; id < n; ++id) {
+            if (!is_core[id]) continue;
+            for (const auto neighbor_id : neighbors_of(id)) {
+                if (!is_core[neighbor_id]) atomic_fetch_min(border_labels[neighbor_id], labels[id]);
+            }
+        }
+
+#pragma omp parallel for
+        for (int id = 0; id < n; ++id) {
+            const auto border_label = border_labels[id].load(memory_order_relaxed);
+            if (!is_core[id] && border_label != numeric_limits<int>::max())
+                labels[id] = border_label;
+        }
+        return labels;
+    }
+
+    // members of each cluster in ascending id order; noise (-1) is left out
+    Clusters make_clusters(const vector<int>& labels) {
+        Clusters clusters;
+        for (int id = 0; id < labels.size(); ++id) {
+            if (labels[id] < 0) continue;
+            if (labels[id] >= clusters.size()) clusters.resize(labels[id] + 1);
+            clusters[labels[id]].emplace_back(id);
+        }
+        return clusters;
+    }
+
+    // The grid of Gan & Tao's DBSCAN: cells of side just under
+    // radius / sqrt(dim), so that any two points sharing a cell are within
+    // radius. Point ids are grouped by cell (cell c holds
+    // order[offsets[c], offsets[c + 1])), and neighbor_cells lists the other
+    // cells close enough to hold a point within radius of cell c. Cells near
+    // a cell are found through a list of offsets in low dimensions and by
+    // scanning all cells when that list would be longer than the grid.
+    template <typename T>
+    struct BasicCellGrid {
+        Matrix<T> points;
+        double radius;
+        double side;
+        size_t dim;
+        vector<int> order;
+        vector<size_t> offsets;
+        vector<long long> coords;  // n_cells x dim
+        unordered_map<size_t, vector<int>> lookup;  // cell_hash -> cells
+        vector<vector<long long>> near_offsets;     // empty: scan all cells
+
+        BasicCellGrid(const Matrix<T>& points, double radius) :
+                points(points), radius(radius), side(radius / sqrt(max<size_t>(1, points.dim)) * (1 - 1e-9)),
+                dim(points.dim) {
+            const auto n = points.size();
+            vector<long long> point_coords(n * dim);
+#pragma omp parallel for
+            for (int id = 0; id < n; ++id) {
+                for (size_t d = 0; d < dim; ++d)
+                    point_coords[id * dim + d] = static_cast<long long>(floor(points[id][d] / side));
+            }
+            const auto coords_of = [&](int id) { return point_coords.data() + id * dim; };
+
+            order.resize(n);
+            iota(order.begin(), order.end(), 0);
+            sort(order.begin(), order.end(), [&](int a, int b) {
+                return lexicographical_compare(coords_of(a), coords_of(a) + dim, coords_of(b), coords_of(b) + dim);
+            });
+            for (size_t i = 0; i < n; ++i) {
+                const auto cell = coords_of(order[i]);
+                if (i == 0 || !equal(cell, cell + dim, coords_of(order[i - 1]))) {
+                    offsets.emplace_back(i);
+                    coords.insert(coords.end(), cell, cell + dim);
+                }
+            }
+            offsets.emplace_back(n);
+            for (int c = 0; c < size(); ++c) lookup[cell_hash(cell(c))].emplace_back(c);
+
+            // offsets {-reach, ..., reach}^dim of cells within radius, if
+            // there are fewer of them than cells
+            const auto reach = static_cast<long long>(ceil(radius / side));
+            if (pow(2.0 * reach + 1, dim) > size()) return;
+            vector<long long> offset(dim, -reach);
+            while (true) {
+                if (any_of(offset.begin(), offset.end(), [](long long o) { return o != 0; }) &&
+                    gap(offset.data()) < radius * radius) {
+                    near_offsets.emplace_back(offset);
+                }
+                size_t d = 0;
+                for (; d < dim; ++d) {
+                    if (++offset[d] <= reach) break;
+                    offset[d] = -reach;
+                }
+                if (d == dim) break;
+            }
+        }
+
+        size_t size() const { return offsets.size() - 1; }
+
+        const long long* cell(int c) const { return coords.data() + c * dim; }
+
+        static size_t cell_hash(const long long* cell, size_t dim) {
+            size_t hash = 0;
+            for (size_t d = 0; d < dim; ++d) {
+                hash ^= static_cast<size_t>(cell[d]) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+
+        size_t cell_hash(const long long* cell) const { return cell_hash(cell, dim); }
+
+        // smallest squared distance between points of two cells offset apart
+        double gap(const long long* offset) const {
+            double sum = 0;
+            for (size_t d = 0; d < dim; ++d) {
+                const auto cells = max<long long>(0, abs(offset[d]) - 1);
+                sum += cells * side * cells * side;
+            }
+            return sum;
+        }
+
+        // the cell at coordinates cell, or -1
+        int find_cell(const long long* cell) const {
+            const auto it = lookup.find(cell_hash(cell));
+            if (it == lookup.end()) return -1;
+            for (const auto c : it->second) {
+                if (equal(cell, cell + dim, this->cell(c))) return c;
+            }
+            return -1;
+        }
+
+        // cells that can hold a point within radius of point, which need not
+        // be one of the grid's: its own cell and those at near_offsets from it
+        void cells_near(const T* point, vector<long long>& cell, vector<int>& result) const {
+            result.clear();
+            cell.resize(dim);
+            for (size_t d = 0; d < dim; ++d) cell[d] = static_cast<long long>(floor(point[d] / side));
+            const auto own = find_cell(cell.data());
+            if (own >= 0) result.emplace_back(own);
+            vector<long long> target(dim);
+            for (const auto& near : near_offsets) {
+                for (size_t d = 0; d < dim; ++d) target[d] = cell[d] + near[d];
+                const auto other = find_cell(target.data());
+                if (other >= 0) result.emplace_back(other);
+            }
+        }
+
+        void neighbor_cells(int c, vector<int>& result) const {
+            result.clear();
+            vector<long long> offset(dim);
+            if (near_offsets.empty()) {
+                for (int other = 0; other < size(); ++other) {
+                    for (size_t d = 0; d < dim; ++d) offset[d] = cell(other)[d] - cell(c)[d];
+                    if (other != c && gap(offset.data()) < radius * radius) result.emplace_back(other);
+                }
+                return;
+            }
+            vector<long long> target(dim);
+            for (const auto& near : near_offsets) {
+                for (size_t d = 0; d < dim; ++d) target[d] = cell(c)[d] + near[d];
+                const auto other = find_cell(target.data());
+                if (other >= 0) result.emplace_back(other);
+            }
+        }
+    };
+
+    // eps-neighborhoods at the largest eps of a parameter sweep with each list
+    // sorted by distance, so that the neighborhood at any smaller eps is a
+    // prefix of it and one search serves every (eps, minpts) of the sweep.
+    struct SweepNeighbors {
+        NeighborTable<> table;
+        vector<double> squared_distances;  // parallel to table.indices
+
+        template <typename T>
+        SweepNeighbors(const RangeIndex& index, const Matrix<T>& points, double max_eps) {
+            const auto distance_to = [&](int id, int neighbor_id) {
+                return squared_l2(points.row_data(id), points.row_data(neighbor_id), points.dim);
+            };
+            table = build_neighbor_table(points.size(), [&](int id, vector<int>& out) {
+                vector<pair<double, int>> by_distance;
+                for (const auto neighbor_id : index.range_search(id, max_eps))
+                    by_distance.emplace_back(distance_to(id, neighbor_id), neighbor_id);
+                sort(by_distance.begin(), by_distance.end());
+                for (const auto& neighbor : by_distance) out.emplace_back(neighbor.second);
+            });
+            squared_distances.resize(table.n_edges());
+#pragma omp parallel for schedule(dynamic, 1024)
+            for (int id = 0; id < table.size(); ++id) {
+                for (auto i = table.offsets[id]; i < table.offsets[id + 1]; ++i)
+                    squared_distances[i] = distance_to(id, table.indices[i]);
+            }
+        }
+
+        size_t size() const { return table.size(); }
+
+        // neighbors of id closer than eps, nearest first
+        NeighborTable<>::Neighbors within(int id, double eps) const {
+            const auto first = squared_distances.begin() + table.offsets[id];
+            const auto last = squared_distances.begin() + table.offsets[id + 1];
+            const auto count = lower_bound(first, last, eps * eps) - first;
+            const auto neighbors = table[id];
+            return {neighbors.first, neighbors.first + count};
+        }
+
+        // OPTICS core distance: distance to the minpts-th neighbor, infinite
+        // beyond the sweep's largest eps; id is core at eps iff it is < eps
+        double core_distance(int id, int minpts) const {
+            const auto neighbors = table[id];
+            if (minpts <= 0) return 0;
+            if (minpts > neighbors.size()) return numeric_limits<double>::infinity();
+            return sqrt(squared_distances[table.offsets[id] + minpts - 1]);
+        }
+    };
+
+    struct SweepResult {
+        double eps;
+        int minpts;
+        vector<int> labels;
+        int n_clusters = 0;
+        size_t n_core = 0;
+        size_t n_border = 0;
+        size_t n_noise = 0;
+        size_t largest_cluster = 0;
+    };
+
+    // Labels for every (eps, minpts) pair of the grid from one search at the
+    // largest eps; each labeling equals DBSCAN::fit with those parameters and
+    // costs a pass over the sorted neighbor lists instead of a new search.
+    template <typename T>
+    vector<SweepResult> sweep_parameters(const Matrix<T>& points, const vector<double>& eps_values,
+                                         const vector<int>& minpts_values,
+                                         IndexType index_type = IndexType::automatic,
+                                         const NNDescentParams& graph_params = NNDescentParams()) {
+        if (eps_values.empty() || minpts_values.empty()) return {};
+        const auto max_eps = *max_element(eps_values.begin(), eps_values.end());
+        const auto index = make_index(index_type, points, max_eps, graph_params);
+        const SweepNeighbors neighbors(*index, points, max_eps);
+
+        vector<SweepResult> results;
+        for (const auto eps : eps_values) {
+            for (const auto minpts : minpts_values) {
+                SweepResult result;
+                result.eps = eps;
+                result.minpts = minpts;
+                result.labels = label_clusters(points.size(), minpts,
+                                               [&](int id) { return neighbors.within(id, eps); });
+                vector<size_t> cluster_sizes;
+                for (int id = 0; id < points.size(); ++id) {
+                    const auto label = result.labels[id];
+                    if (label < 0) {
+                        ++result.n_noise;
+                        continue;
+                    }
+                    if (neighbors.within(id, eps).size() >= minpts) ++result.n_core;
+                    else ++result.n_border;
+                    if (label >= cluster_sizes.size()) cluster_sizes.resize(label + 1);
+                    ++cluster_sizes[label];
+                }
+                result.n_clusters = cluster_sizes.size();
+                if (!cluster_sizes.empty())
+                    result.largest_cluster = *max_element(cluster_sizes.begin(), cluster_sizes.end());
+                results.emplace_back(move(result));
+            }
+        }
+        return results;
+    }
+
+    // Temporary directory that is removed, with the files made through
+    // file(), when it goes out of scope.
+    struct TemporaryDirectory {
+        string path;
+        vector<string> files;
+
+        explicit TemporaryDirectory(const string& parent) {
+            string pattern = parent + "/dbscan_XXXXXX";
+            if (!mkdtemp(&pattern[0])) throw runtime_error("Can't create directory!: " + parent);
+            path = pattern;
+        }
+
+        TemporaryDirectory(const TemporaryDirectory&) = delete;
+        TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+
+        ~TemporaryDirectory() {
+            for (const auto& file : files) unlink(file.c_str());
+            rmdir(path.c_str());
+        }
+
+        string file(const string& name) {
+            files.emplace_back(path + '/' + name);
+            return files.back();
+        }
+    };
+
+    template <typename T>
+    void append_to_file(const string& path, const vector<T>& values) {
+        ofstream ofs(path, ios::binary | ios::app);
+        if (!ofs) throw runtime_error("Can't open file!: " + path);
+        ofs.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    template <typename T>
+    vector<T> read_whole_file(const string& path) {
+        ifstream ifs(path, ios::binary | ios::ate);
+        if (!ifs) return vector<T>();
+        vector<T> values(static_cast<size_t>(ifs.tellg()) / sizeof(T));
+        ifs.seekg(0);
+        ifs.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+        return values;
+    }
+
+    // Splits the axis `split_dim` into slabs whose points, together with the
+    // points within eps of either side (the halo), number at most
+    // `max_rows`, judging from a histogram of the coordinates. A slab is
+    // never narrower than eps (so a point lies in at most three slabs), which
+    // lets dense regions exceed the limit. Returns the slab bounds, -inf
+    // first and +inf last.
+    vector<double> plan_slabs(const vector<size_t>& histogram, double low, double high,
+                              double eps, size_t max_rows) {
+        const auto n_bins = histogram.size();
+        const auto bin_width = (high - low) / n_bins;
+        vector<size_t> prefix(n_bins + 1);
+        for (size_t bin = 0; bin < n_bins; ++bin) prefix[bin + 1] = prefix[bin] + histogram[bin];
+        const auto halo_bins = bin_width > 0 ? static_cast<size_t>(ceil(eps / bin_width)) : n_bins;
+        const auto rows_with_halo = [&](size_t first, size_t last) {
+            return prefix[min(n_bins, last + halo_bins)] - prefix[first - min(first, halo_bins)];
+        };
+
+        vector<double> bounds = {-numeric_limits<double>::infinity()};
+        for (size_t first = 0; first < n_bins;) {
+            auto last = first + 1;
+            while (last < n_bins &&
+                   (last - first < halo_bins || rows_with_halo(first, last + 1) <= max_rows)) ++last;
+            if (last < n_bins) bounds.emplace_back(low + last * bin_width);
+            first = last;
+        }
+        bounds.emplace_back(numeric_limits<double>::infinity());
+        return bounds;
+    }
+
+    enum class PointKind : uint8_t { noise = 0, border = 1, core = 2 };
+
+    const vector<string> point_kind_names = {"noise", "border", "core"};
+
+    // Binary label file: this 64-byte header, n_points int32 cluster ids
+    // (-1 for noise), then n_points PointKind bytes if has_kinds. The ids
+    // start cache-line aligned, so the file can be mapped and used in place.
+    struct LabelHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t has_kinds;
+        uint64_t n_points;
+        uint64_t n_clusters;
+        char reserved[32];
+    };
+    static_assert(sizeof(LabelHeader) == 64, "LabelHeader must stay 64 bytes");
+
+    constexpr char label_magic[8] = {'A', 'R', 'A', 'I', 'L', 'A', 'B', 'L'};
+
+    // cluster ids of a label file, and its point kinds if kinds is given
+    vector<int> load_labels(const string& path, vector<PointKind>* kinds = nullptr) {
+        const MappedFile file(path);
+        LabelHeader header;
+        if (file.size < sizeof(header)) throw runtime_error("Invalid label file!: " + path);
+        memcpy(&header, file.data(), sizeof(header));
+        const auto labels_size = header.n_points * sizeof(int32_t);
+        if (memcmp(header.magic, label_magic, sizeof(label_magic)) != 0 ||
+            file.size < sizeof(header) + labels_size + (header.has_kinds ? header.n_points : 0)) {
+            throw runtime_error("Invalid label file!: " + path);
+        }
+
+        vector<int> labels(header.n_points);
+        parallel_copy(reinterpret_cast<const int32_t*>(file.data() + sizeof(header)), header.n_points,
+                      labels.data());
+        if (kinds) {
+            if (!header.has_kinds) throw runtime_error("Label file has no point kinds!: " + path);
+            const auto first = reinterpret_cast<const PointKind*>(file.data() + sizeof(header) + labels_size);
+            kinds->assign(first, first + header.n_points);
+        }
+        return labels;
+    }
+
+    // Writes labels as a binary label file (.bin, see LabelHeader) or as csv
+    // lines under a "cluster_id" header, formatted in parallel; kinds, if
+    // given, adds a "kind" column.
+    void save_labels(const string& save_path, const vector<int>& labels, size_t n_clusters,
+                     const vector<PointKind>* kinds = nullptr) {
+        if (is_binary(save_path)) {
+            ofstream ofs(save_path, ios::binary);
+            if (!ofs) throw runtime_error("Can't open file!: " + save_path);
+            LabelHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, label_magic, sizeof(label_magic));
+            header.version = 1;
+            header.has_kinds = kinds != nullptr;
+            header.n_points = labels.size();
+            header.n_clusters = n_clusters;
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            const vector<int32_t> ids(labels.begin(), labels.end());
+            ofs.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(int32_t));
+            if (kinds) ofs.write(reinterpret_cast<const char*>(kinds->data()), kinds->size());
+            if (!ofs) throw runtime_error("Can't write file!: " + save_path);
+            return;
+        }
+
+        ofstream ofs(save_path);
+        if (!ofs) throw runtime_error("Can't open file!: " + save_path);
+        ofs << (kinds ? "cluster_id,kind\n" : "cluster_id\n");
+        constexpr size_t block_size = 1 << 16;
+        write_blocks(ofs, (labels.size() + block_size - 1) / block_size, [&](size_t block) {
+            string text;
+            for (auto id = block * block_size; id < min(labels.size(), (block + 1) * block_size); ++id) {
+                append_int(text, labels[id]);
+                if (kinds) {
+                    text += ',';
+                    text += point_kind_names[static_cast<int>((*kinds)[id])];
+                }
+                text += '\n';
+            }
+            return text;
+        });
+        if (!ofs) throw runtime_error("Can't write file!: " + save_path);
+    }
+
+    // Binary model file: this 64-byte header, the n_core x dim core points
+    // (as Metric maps them, in dtype) and their int32 cluster ids. Like a
+    // binary dataset it is mapped and used in place when loaded.
+    struct ModelHeader {
+        char magic[8];
+        uint32_t version;
+        DType dtype;
+        uint64_t n_core;
+        uint64_t dim;
+        double eps;
+        uint32_t metric;  // 0: Euclidean, 1: Angular
+        uint32_t n_clusters;
+        char reserved[16];
+    };
+    static_assert(sizeof(ModelHeader) == 64, "ModelHeader must stay 64 bytes");
+
+    constexpr char model_magic[8] = {'A', 'R', 'A', 'I', 'M', 'O', 'D', 'L'};
+
+    template <typename Metric> uint32_t metric_id();
+    template <> uint32_t metric_id<Euclidean>() { return 0; }
+    template <> uint32_t metric_id<Angular>() { return 1; }
+
+    // What labeling new points needs of a fit: the core points and their
+    // cluster ids. predict gives a point the cluster of its nearest core
+    // point within eps, or -1, so a point of the fitted data gets the label
+    // fit gave it unless it is a border point between clusters. Core points
+    // are searched on a BasicCellGrid, built on construction or load, in low
+    // dimensions, and scanned in tiles with the SIMD kernels in high ones,
+    // where a grid cannot prune. The model is immutable, so any number of
+    // threads may predict at once.
+    template <typename T, typename Metric = Euclidean>
+    struct BasicDBSCANModel {
+        double eps = 0;
+        size_t n_clusters = 0;
+        Matrix<T> core_points;
+        shared_ptr<const int32_t> core_labels;  // may point into a mapped file
+        unique_ptr<BasicCellGrid<T>> grid;  // null: scan all core points
+
+        BasicDBSCANModel() = default;
+
+        BasicDBSCANModel(double eps, size_t n_clusters, const Matrix<T>& core_points, vector<int32_t> labels) :
+                eps(eps), n_clusters(n_clusters), core_points(core_points) {
+            const auto stored = make_shared<vector<int32_t>>(move(labels));
+            core_labels = shared_ptr<const int32_t>(stored, stored->data());
+            build_index();
+        }
+
+        size_t size() const { return core_points.size(); }
+
+        bool empty() const { return core_points.empty(); }
+
+        size_t dim() const { return core_points.dim; }
+
+        double radius() const { return Metric::radius(eps); }
+
+        void build_index() {
+            grid.reset();
+            if (core_points.empty() || !(radius() > 0)) return;
+            grid.reset(new BasicCellGrid<T>(core_points, radius()));
+            if (grid->near_offsets.empty()) grid.reset();
+        }
+
+        // buffers a thread reuses across queries
+        struct Scratch {
+            vector<T> query;
+            vector<long long> cell;
+            vector<int> cells;
+            vector<T> distances;
+        };
+
+        // cluster id of the nearest core point within eps of point, or -1;
+        // ties go to the core point stored first
+        template <size_t Dim>
+        int predict_one(const T* point, Scratch& scratch, FixedDim<Dim> fixed_dim) const {
+            if (empty() || !(radius() > 0)) return -1;
+            scratch.query.assign(point, point + dim());
+            Metric::prepare(scratch.query.data(), dim());
+            const auto query = scratch.query.data();
+
+            double best = radius() * radius();
+            int nearest = -1;
+            const auto consider = [&](int core_id, double dist) {
+                if (dist < best || (dist == best && core_id < nearest)) {
+                    best = dist;
+                    nearest = core_id;
+                }
+            };
+            if (grid) {
+                grid->cells_near(query, scratch.cell, scratch.cells);
+                for (const auto c : scratch.cells) {
+                    for (auto i = grid->offsets[c]; i < grid->offsets[c + 1]; ++i) {
+                        const auto core_id = grid->order[i];
+                        consider(core_id, squared_l2(query, core_points.row_data(core_id), dim(), fixed_dim));
+                    }
+                }
+            } else {
+                static const auto tile = squared_l2_tile_kernel<T>();
+                constexpr size_t tile_size = 256;
+                scratch.distances.resize(tile_size);
+                for (size_t begin = 0; begin < size(); begin += tile_size) {
+                    const auto count = min(tile_size, size() - begin);
+                    tile(query, core_points.row_data(begin), count, dim(), scratch.distances.data());
+                    for (size_t i = 0; i < count; ++i) consider(begin + i, scratch.distances[i]);
+                }
+            }
+            return nearest < 0 ? -1 : core_labels.get()[nearest];
+        }
+
+        // labels[i] for every row of batch, in parallel; labels must hold
+        // batch.size() ints
+        void predict(const Matrix<T>& batch, int* labels) const {
+            if (!empty() && batch.dim != dim()) throw runtime_error("Inconsistent dimension!");
+            dispatch_dim(batch.dim, [&](auto fixed_dim) {
+#pragma omp parallel
+                {
+                    Scratch scratch;
+#pragma omp for schedule(dynamic, 256)
+                    for (int i = 0; i < batch.size(); ++i)
+                        labels[i] = predict_one(batch.row_data(i), scratch, fixed_dim);
+                }
+            });
+        }
+
+        vector<int> predict(const Matrix<T>& batch) const {
+            vector<int> labels(batch.size());
+            predict(batch, labels.data());
+            return labels;
+        }
+
+
+        void save(const string& path) const {
+            ofstream ofs(path, ios::binary);
+            if (!ofs) throw runtime_error("Can't open file!: " + path);
+            ModelHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, model_magic, sizeof(model_magic));
+            header.version = 1;
+            header.dtype = dtype_of<T>();
+            header.n_core = size();
+            header.dim = dim();
+            header.eps = eps;
+            header.metric = metric_id<Metric>();
+            header.n_clusters = n_clusters;
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            ofs.write(reinterpret_cast<const char*>(core_points.data()), size() * dim() * sizeof(T));
+            ofs.write(reinterpret_cast<const char*>(core_labels.get()), size() * sizeof(int32_t));
+            if (!ofs) throw runtime_error("Can't write file!: " + path);
+        }
+
+        // maps a file written by save; the core points and labels stay in
+        // the mapping, only the search index is built
+        static BasicDBSCANModel load(const string& path) {
+            const auto file = make_shared<MappedFile>(path);
+            ModelHeader header;
+            if (file->size < sizeof(header)) throw runtime_error("Invalid model file!: " + path);
+            memcpy(&header, file->data(), sizeof(header));
+            const auto points_size = header.n_core * header.dim * sizeof(T);
+            if (memcmp(header.magic, model_magic, sizeof(model_magic)) != 0 ||
+                file->size < sizeof(header) + points_size + header.n_core * sizeof(int32_t)) {
+                throw runtime_error("Invalid model file!: " + path);
+            }
+            if (header.dtype != dtype_of<T>()) throw runtime_error("Model has another dtype!: " + path);
+            if (header.metric != metric_id<Metric>()) throw runtime_error("Model has another metric!: " + path);
+
+            BasicDBSCANModel model;
+            model.eps = header.eps;
+            model.n_clusters = header.n_clusters;
+            model.core_points.n_rows = header.n_core;
+            model.core_points.dim = header.dim;
+            const auto payload = file->data() + sizeof(header);
+            model.core_points.storage = shared_ptr<T>(file, reinterpret_cast<T*>(payload));
+            model.core_labels = shared_ptr<const int32_t>(file, reinterpret_cast<const int32_t*>(payload + points_size));
+            model.build_index();
+            return model;
+        }
+    };
+
+    // DBSCAN over coordinates of scalar type T; float halves the memory of
+    // double and doubles the lanes of the SIMD distance kernels. eps is in
+    // Metric's distance; database.points holds the points as Metric maps
+    // them (unit vectors for Angular), on which all searches run in L2.
+    template <typename T, typename Metric = Euclidean>
+    struct BasicDBSCAN {
+        double eps;
+        int minpts;
+        BasicDatabase<T> database;
+        Clusters clusters;
+
+        IndexType index_type;
+        NNDescentParams graph_params;  // used by IndexType::nn_descent
+        FitStats* stats = nullptr;     // see FitStats
+
+        // state for insert/remove: neighbor counts set by fit, tombstones for
+        // removed ids, and a grid built on the first update (low dimensions)
+        vector<int> n_neighbors;
+        vector<char> removed;
+        unique_ptr<BasicGridIndex<T>> update_grid;
+        bool capped_counts = false;  // n_neighbors stops at minpts, see fit_cells
+        // built by predict, dropped whenever the clustering changes
+        shared_ptr<const BasicDBSCANModel<T, Metric>> model;
+
+        BasicDBSCAN(double eps, int minpts, IndexType index_type = IndexType::automatic) :
+                eps(eps), minpts(minpts), index_type(index_type) {}
+
+        // eps as a euclidean radius over database.points
+        double radius() const { return Metric::radius(eps); }
+
+        auto scan_eps_neighbors(int point_id) {
+            return BasicBruteForceIndex<T>(database.points).range_search(point_id, radius());
+        }
+
+        // eps-neighborhoods of all points through the configured index; the
+        // result can be passed to fit again, e.g. to try several minpts
+        NeighborTable<> compute_eps_neighbors(const Matrix<T>& points) const {
+            return prepared_eps_neighbors(prepare_points<Metric>(points));
+        }
+
+        // compute_eps_neighbors of points already mapped by Metric
+        NeighborTable<> prepared_eps_neighbors(const Matrix<T>& prepared) const {
+            const auto start = get_now();
+            const auto index = make_index(index_type, prepared, radius(), graph_params);
+            if (stats) stats->add_phase("index", start);
+            return dbscan::compute_eps_neighbors(*index, prepared.size(), radius(), stats);
+        }
+
+        // cite from https://ja.wikipedia.org/wiki/DBSCAN
+        // eps_neighbors is anything whose [id] yields the neighbor ids of id:
+        // a NeighborTable, a DeltaNeighborTable or a vector<vector<int>>
+        template <typename EpsNeighbors>
+        void fit(const Matrix<T>& points, const EpsNeighbors& eps_neighbors) {
+            fit_prepared(prepare_points<Metric>(points), eps_neighbors);
+        }
+
+        // fit on points already mapped by Metric, which become database.points
+        // as they are: an angular fit normalizes its input only once
+        template <typename EpsNeighbors>
+        void fit_prepared(const Matrix<T>& prepared, const EpsNeighbors& eps_neighbors) {
+            const auto start = get_now();
+            database = BasicDatabase<T>(prepared);
+            database.cluster_ids = label_clusters(
+                    database.size(), minpts,
+                    [&](int id) -> decltype(auto) { return eps_neighbors[id]; });
+            clusters = make_clusters(database.cluster_ids);
+            if (stats) stats->add_phase("labeling", start);
+
+            n_neighbors.resize(database.size());
+#pragma omp parallel for
+            for (int id = 0; id < database.size(); ++id) n_neighbors[id] = eps_neighbors[id].size();
+            removed.assign(database.size(), 0);
+            update_grid.reset();
+            model.reset();
+            capped_counts = false;
+            if (stats) count_point_kinds();
+        }
+
+        // core, border and noise counts and the neighbor count histogram
+        void count_point_kinds() const {
+            stats->set_neighbor_counts(n_neighbors);
+            stats->n_core = stats->n_border = stats->n_noise = 0;
+            for (int id = 0; id < database.size(); ++id) {
+                if (database.cluster_ids[id] < 0) ++stats->n_noise;
+                else if (is_core(id)) ++stats->n_core;
+                else ++stats->n_border;
+            }
+            stats->n_clusters = clusters.size();
+        }
+
+        void fit(const Matrix<T>& points) {
+            const auto prepared = prepare_points<Metric>(points);
+            fit_prepared(prepared, prepared_eps_neighbors(prepared));
+        }
+
+        // calculate eps neighbors if eps_neighbors_list is empty
+        void fit(const Dataset<T>& dataset,
+                 const vector<vector<int>>& eps_neighbors_list = vector<vector<int>>()) {
+            if (eps_neighbors_list.empty()) fit(to_matrix<T>(dataset));
+            else fit(to_matrix<T>(dataset), eps_neighbors_list);
+        }
+
+        void fit(string data_path, int n = -1) {
+            const auto start = get_now();
+            const auto points = load_matrix<T>(data_path, n);
+            if (stats) stats->add_phase("load", start);
+            fit(points);
+        }
+
+        // Clusters without neighbor lists, in the manner of Gan & Tao: on a
+        // BasicCellGrid, neighbors are counted only until minpts is reached
+        // (a cell of more than minpts points is all core without a distance),
+        // core points of a cell are united at once and those of nearby cells
+        // by a search for one close enough pair, and border points look for
+        // core points only after that. Memory stays O(n) however many
+        // neighbors eps covers. With rho = 0 the result equals fit's; with
+        // rho > 0 two core points within eps are always connected, two beyond
+        // eps * (1 + rho) never, and in between either way (rho-approximate
+        // DBSCAN), which lets the pair searches stop sooner. n_neighbors is
+        // kept only up to minpts, enough for insert but not for remove.
+        void fit_cells(const Matrix<T>& points, double rho = 0) {
+            // no point has a neighbor within eps <= 0
+            if (!(radius() > 0)) return fit(points, vector<vector<int>>(points.size()));
+
+            auto start = get_now();
+            database = BasicDatabase<T>(prepare_points<Metric>(points));
+            const auto n = database.size();
+            const BasicCellGrid<T> grid(database.points, radius());
+            if (stats) stats->add_phase("index", start);
+
+            start = get_now();
+            const auto& rows = database.points;
+            const auto threshold = radius() * radius();
+            const auto within = [&](int a, int b, double threshold) {
+                return squared_l2(rows.row_data(a), rows.row_data(b), rows.dim) < threshold;
+            };
+            const auto members = [&](int c) {
+                return make_pair(grid.order.begin() + grid.offsets[c], grid.order.begin() + grid.offsets[c + 1]);
+            };
+
+            // neighbor counts up to minpts
+            n_neighbors.assign(n, 0);
+            size_t n_distances = 0;
+#pragma omp parallel for schedule(dynamic, 16) reduction(+ : n_distances)
+            for (int c = 0; c < grid.size(); ++c) {
+                vector<int> near;
+                const auto cell = members(c);
+                const int cell_size = cell.second - cell.first;
+                if (cell_size > minpts) {
+                    for (auto it = cell.first; it != cell.second; ++it) n_neighbors[*it] = minpts;
+                    continue;
+                }
+                grid.neighbor_cells(c, near);
+                for (auto it = cell.first; it != cell.second; ++it) {
+                    auto count = cell_size - 1;
+                    for (size_t k = 0; k < near.size() && count < minpts; ++k) {
+                        const auto other = members(near[k]);
+                        for (auto jt = other.first; jt != other.second && count < minpts; ++jt) {
+                            ++n_distances;
+                            if (within(*it, *jt, threshold)) ++count;
+                        }
+                    }
+                    n_neighbors[*it] = count;
+                }
+            }
+            if (stats) {
+                stats->add_phase("core_points", start);
+                stats->n_distances += n_distances;
+            }
+
+            // core points of a cell, then of nearby cells, in one union-find
+            start = get_now();
+            n_distances = 0;
+            const auto connect_threshold = pow(radius() * (1 + rho), 2);
+            vector<int> first_core(grid.size(), -1);
+#pragma omp parallel for
+            for (int c = 0; c < grid.size(); ++c) {
+                const auto cell = members(c);
+                for (auto it = cell.first; it != cell.second && first_core[c] < 0; ++it) {
+                    if (is_core(*it)) first_core[c] = *it;
+                }
+            }
+            ConcurrentUnionFind union_find(n);
+#pragma omp parallel for schedule(dynamic, 16) reduction(+ : n_distances)
+            for (int c = 0; c < grid.size(); ++c) {
+                if (first_core[c] < 0) continue;
+                const auto cell = members(c);
+                for (auto it = cell.first; it != cell.second; ++it) {
+                    if (is_core(*it)) union_find.unite(first_core[c], *it);
+                }
+
+                vector<int> near;
+                grid.neighbor_cells(c, near);
+                for (const auto other_cell : near) {
+                    if (other_cell < c || first_core[other_cell] < 0 ||
+                        union_find.find(first_core[c]) == union_find.find(first_core[other_cell]))
+                        continue;
+                    const auto other = members(other_cell);
+                    bool connected = false;
+                    for (auto it = cell.first; it != cell.second && !connected; ++it) {
+                        if (!is_core(*it)) continue;
+                        for (auto jt = other.first; jt != other.second && !connected; ++jt) {
+                            if (!is_core(*jt)) continue;
+                            ++n_distances;
+                            connected = within(*it, *jt, connect_threshold);
+                        }
+                    }
+                    if (connected) union_find.unite(first_core[c], first_core[other_cell]);
+                }
+            }
+
+            // clusters numbered by their smallest core point, as in fit; roots
+            // are labeled apart from the labels written in parallel
+            vector<int> root_labels(n, -1);
+            int n_clusters = 0;
+            for (int id = 0; id < n; ++id) {
+                if (is_core(id) && union_find.parent[id].load(memory_order_relaxed) == id)
+                    root_labels[id] = n_clusters++;
+            }
+            auto& labels = database.cluster_ids;
+            labels.assign(n, -1);
+#pragma omp parallel for
+            for (int id = 0; id < n; ++id) {
+                if (is_core(id)) labels[id] = root_labels[union_find.find(id)];
+            }
+
+            // a border point takes the smallest label among its core neighbors
+#pragma omp parallel for schedule(dynamic, 16) reduction(+ : n_distances)
+            for (int c = 0; c < grid.size(); ++c) {
+                const auto cell = members(c);
+                vector<int> near;
+                for (auto it = cell.first; it != cell.second; ++it) {
+                    if (is_core(*it)) continue;
+                    auto label = numeric_limits<int>::max();
+                    if (first_core[c] >= 0) {
+                        for (auto jt = cell.first; jt != cell.second; ++jt) {
+                            if (is_core(*jt)) label = min(label, labels[*jt]);
+                        }
+                    }
+                    if (near.empty()) grid.neighbor_cells(c, near);
+                    for (const auto other_cell : near) {
+                        if (first_core[other_cell] < 0) continue;
+                        const auto other = members(other_cell);
+                        for (auto jt = other.first; jt != other.second; ++jt) {
+                            if (!is_core(*jt) || labels[*jt] >= label) continue;
+                            ++n_distances;
+                            if (within(*it, *jt, threshold)) label = labels[*jt];
+                        }
+                    }
+                    if (label != numeric_limits<int>::max()) labels[*it] = label;
+                }
+            }
+            clusters = make_clusters(labels);
+            if (stats) {
+                stats->add_phase("labeling", start);
+                stats->n_distances += n_distances;
+            }
+
+            capped_counts = true;
+            removed.assign(n, 0);
+            update_grid.reset();
+            model.reset();
+            if (stats) count_point_kinds();
+        }
+
+        bool is_core(int id) const { return n_neighbors[id] >= minpts; }
+
+        // live eps-neighbors of id, excluding removed points
+        vector<int> live_neighbors(int id) const {
+            auto neighbors = update_grid ? update_grid->range_search(id, radius())
+                                         : BasicBruteForceIndex<T>(database.points).range_search(id, radius());
+            neighbors.erase(remove_if(neighbors.begin(), neighbors.end(),
+                                      [&](int neighbor_id) { return removed[neighbor_id]; }),
+                            neighbors.end());
+            return neighbors;
+        }
+
+        // brings the update index up to date with rows from first_new on
+        void sync_update_index(size_t first_new) {
+            if (database.dim() > 3) return;
+            if (!update_grid) {
+                update_grid.reset(new BasicGridIndex<T>(database.points, radius()));
+                for (int id = 0; id < first_new; ++id) {
+                    if (removed[id]) update_grid->remove(id);
+                }
+                return;
+            }
+            update_grid->points = database.points;
+            for (size_t id = first_new; id < database.size(); ++id) update_grid->insert(id);
+        }
+
+        // Renumbers labels so that clusters are ordered by their smallest core
+        // point, as fit numbers them, and rebuilds clusters.
+        void renumber_clusters() {
+            auto& labels = database.cluster_ids;
+            const auto n_labels = labels.empty() ? 0 : *max_element(labels.begin(), labels.end()) + 1;
+            vector<int> new_label(n_labels, -1);
+            int n_clusters = 0;
+            for (int id = 0; id < labels.size(); ++id) {
+                if (labels[id] >= 0 && is_core(id) && new_label[labels[id]] < 0)
+                    new_label[labels[id]] = n_clusters++;
+            }
+#pragma omp parallel for
+            for (int id = 0; id < labels.size(); ++id) {
+                if (labels[id] >= 0) labels[id] = new_label[labels[id]];
+            }
+            clusters = make_clusters(labels);
+            model.reset();
+        }
+
+        // Adds points after a fit and returns the id of the first one. Only the
+        // neighborhoods of the new points and of points that become core are
+        // searched: new core points join or merge the clusters they touch and
+        // noise next to them becomes border. Core points and noise end up as a
+        // refit would label them; a border point near several clusters keeps
+        // one it is reachable from, which may differ from the refit's pick.
+        size_t insert(const Matrix<T>& new_points) {
+            // fit_out_of_core keeps the labels but neither points nor counts
+            if (n_neighbors.size() != database.cluster_ids.size())
+                throw runtime_error("insert needs the points and neighbor counts of fit!");
+            if (database.empty()) database = BasicDatabase<T>(Matrix<T>(0, new_points.dim));
+            if (new_points.dim != database.dim()) throw runtime_error("Inconsistent dimension!");
+
+            const auto first = database.size();
+            const int n_new = new_points.size();
+            database.points.append(prepare_points<Metric>(new_points).data(), n_new);
+            database.cluster_ids.resize(database.size(), -1);
+            n_neighbors.resize(database.size(), 0);
+            removed.resize(database.size(), 0);
+            sync_update_index(first);
+
+            vector<vector<int>> new_neighbors(n_new);
+#pragma omp parallel for schedule(dynamic, 64)
+            for (int i = 0; i < n_new; ++i) new_neighbors[i] = live_neighbors(first + i);
+
+            // points that are core now but were not before: the new core
+            // points and old points whose count reaches minpts
+            vector<int> seeds;
+            for (int i = 0; i < n_new; ++i) {
+                n_neighbors[first + i] = new_neighbors[i].size();
+                if (is_core(first + i)) seeds.emplace_back(first + i);
+                for (const auto neighbor_id : new_neighbors[i]) {
+                    if (neighbor_id < first && ++n_neighbors[neighbor_id] == minpts)
+                        seeds.emplace_back(neighbor_id);
+                }
+            }
+
+            vector<vector<int>> seed_neighbors(seeds.size());
+#pragma omp parallel for schedule(dynamic, 64)
+            for (int s = 0; s < seeds.size(); ++s) {
+                seed_neighbors[s] = seeds[s] >= first ? new_neighbors[seeds[s] - first]
+                                                      : live_neighbors(seeds[s]);
+            }
+
+            // union-find over units: the existing clusters, then one per seed
+            auto& labels = database.cluster_ids;
+            const int n_clusters = clusters.size();
+            unordered_map<int, int> seed_unit;
+            for (int s = 0; s < seeds.size(); ++s) seed_unit[seeds[s]] = n_clusters + s;
+            const auto unit_of = [&](int id) {
+                const auto it = seed_unit.find(id);
+                return it != seed_unit.end() ? it->second : labels[id];
+            };
+
+            ConcurrentUnionFind units(n_clusters + seeds.size());
+            for (int s = 0; s < seeds.size(); ++s) {
+                for (const auto neighbor_id : seed_neighbors[s]) {
+                    if (is_core(neighbor_id)) units.unite(n_clusters + s, unit_of(neighbor_id));
+                }
+            }
+
+            for (int id = 0; id < first; ++id) {
+                if (labels[id] >= 0) labels[id] = units.find(labels[id]);
+            }
+            for (int s = 0; s < seeds.size(); ++s) labels[seeds[s]] = units.find(n_clusters + s);
+            for (int s = 0; s < seeds.size(); ++s) {
+                for (const auto neighbor_id : seed_neighbors[s]) {
+                    if (!is_core(neighbor_id) && labels[neighbor_id] < 0)
+                        labels[neighbor_id] = labels[seeds[s]];
+                }
+            }
+            // new border points next to core points that were core already
+            for (int i = 0; i < n_new; ++i) {
+                if (labels[first + i] >= 0) continue;
+                for (const auto neighbor_id : new_neighbors[i]) {
+                    if (is_core(neighbor_id)) {
+                        labels[first + i] = labels[neighbor_id];
+                        break;
+                    }
+                }
+            }
+
+            renumber_clusters();
+            return first;
+        }
+
+        size_t insert(const Dataset<T>& dataset) {
+            return insert(to_matrix<T>(dataset));
+        }
+
+        // Removes points after a fit; their ids stay reserved and read as
+        // noise. Only clusters that lose a core point, by removal or because a
+        // neighbor count drops below minpts, are searched again and split into
+        // their remaining connected parts.
+        void remove(const vector<int>& ids) {
+            if (capped_counts || n_neighbors.size() != database.cluster_ids.size())
+                throw runtime_error("remove needs the exact neighbor counts of fit!");
+            for (const auto id : ids) {
+                if (id < 0 || id >= database.size()) throw runtime_error("Invalid point id!");
+            }
+            vector<int> targets;
+            for (const auto id : ids) {
+                if (!removed[id]) targets.emplace_back(id);
+                removed[id] = 1;
+            }
+            if (update_grid) {
+                for (const auto id : targets) update_grid->remove(id);
+            } else {
+                sync_update_index(database.size());
+            }
+
+            vector<vector<int>> removed_neighbors(targets.size());
+#pragma omp parallel for schedule(dynamic, 64)
+            for (int i = 0; i < targets.size(); ++i) removed_neighbors[i] = live_neighbors(targets[i]);
+
+            auto& labels = database.cluster_ids;
+            vector<char> affected(clusters.size());
+            for (int i = 0; i < targets.size(); ++i) {
+                if (is_core(targets[i])) affected[labels[targets[i]]] = 1;
+                for (const auto neighbor_id : removed_neighbors[i]) {
+                    if (n_neighbors[neighbor_id]-- == minpts) affected[labels[neighbor_id]] = 1;
+                }
+            }
+            for (const auto id : targets) {
+                labels[id] = -1;
+                n_neighbors[id] = 0;
+            }
+
+            vector<int> members;
+            for (int c = 0; c < clusters.size(); ++c) {
+                if (!affected[c]) continue;
+                for (const auto id : clusters[c]) {
+                    if (!removed[id]) members.emplace_back(id);
+                }
+            }
+            unordered_map<int, int> local_id;
+            for (int i = 0; i < members.size(); ++i) local_id[members[i]] = i;
+
+            vector<vector<int>> member_neighbors(members.size());
+#pragma omp parallel for schedule(dynamic, 64)
+            for (int i = 0; i < members.size(); ++i) member_neighbors[i] = live_neighbors(members[i]);
+
+            // core points of a cluster only touch core points of the same
+            // cluster, so the split is found among the members alone
+            ConcurrentUnionFind union_find(members.size());
+            for (int i = 0; i < members.size(); ++i) {
+                if (!is_core(members[i])) continue;
+                for (const auto neighbor_id : member_neighbors[i]) {
+                    if (is_core(neighbor_id)) union_find.unite(i, local_id.at(neighbor_id));
+                }
+            }
+
+            // fresh labels above the existing ones for the split parts
+            const int base = clusters.size();
+            for (int i = 0; i < members.size(); ++i) {
+                labels[members[i]] = is_core(members[i]) ? base + union_find.find(i) : -1;
+            }
+            for (int i = 0; i < members.size(); ++i) {
+                if (is_core(members[i])) continue;
+                for (const auto neighbor_id : member_neighbors[i]) {
+                    if (is_core(neighbor_id)) {
+                        labels[members[i]] = labels[neighbor_id];
+                        break;
+                    }
+                }
+            }
+
+            renumber_clusters();
+        }
+
+        // Clusters a dataset that need not fit in memory. The points are
+        // streamed from data_path (a binary dataset, or a CSV file or i.csv
+        // directory that is first converted to one under work_dir), cut into
+        // slabs along their widest axis and spilled to work_dir, each slab with
+        // an eps-wide halo of its neighbors' points. A slab decides the core
+        // status of the points it owns, then unites core points across slab
+        // borders in a union-find over point ids, then labels its border
+        // points; every pass reloads one slab at a time and searches it in
+        // parallel. memory_budget (bytes) bounds the slab and the I/O buffers;
+        // the labels and the union-find add 9 bytes a point on top (13 while
+        // clusters are numbered). n means what it does for load_matrix: rows
+        // of a CSV file, i.csv files of a directory. The result equals fit's;
+        // database.points is left empty.
+        void fit_out_of_core(const string& data_path, size_t memory_budget, int n = -1,
+                             const string& work_dir = "/tmp") {
+            TemporaryDirectory tmp(work_dir);
+            auto binary_path = data_path;
+            if (!is_binary(data_path)) {
+                binary_path = tmp.file("points.bin");
+                convert_to_binary<T>(data_path, binary_path, n);
+            }
+            const BinaryReader<T> reader(binary_path);
+            const auto n_points = reader.size();
+            const auto dim = reader.dim();
+
+            // rows, ids and index of a slab, next to the fixed I/O buffers
+            const auto row_bytes = dim * sizeof(T);
+            const auto max_rows = max<size_t>(1, memory_budget / 2 / (row_bytes + 64));
+            const auto block_rows = max<size_t>(1, memory_budget / 4 / row_bytes);
+            const auto for_each_block = [&](const function<void(const Matrix<T>&, size_t)>& f) {
+                Matrix<T> block(block_rows, dim);
+                for (size_t begin = 0; begin < n_points; begin += block_rows) {
+                    block.n_rows = min(block_rows, n_points - begin);
+                    reader.read(begin, block.n_rows, block.data());
+                    prepare_rows<Metric>(block);
+                    f(block, begin);
+                }
+            };
+
+            // the widest axis, then a histogram of it
+            vector<double> lows(dim, numeric_limits<double>::infinity());
+            vector<double> highs(dim, -numeric_limits<double>::infinity());
+            for_each_block([&](const Matrix<T>& block, size_t) {
+                for (size_t i = 0; i < block.size(); ++i) {
+                    for (size_t d = 0; d < dim; ++d) {
+                        lows[d] = min<double>(lows[d], block[i][d]);
+                        highs[d] = max<double>(highs[d], block[i][d]);
+                    }
+                }
+            });
+            size_t split_dim = 0;
+            for (size_t d = 1; d < dim; ++d) {
+                if (highs[d] - lows[d] > highs[split_dim] - lows[split_dim]) split_dim = d;
+            }
+            const auto low = n_points ? lows[split_dim] : 0.0;
+            const auto high = n_points ? highs[split_dim] : 0.0;
+            vector<size_t> histogram(4096);
+            const auto bin_of = [&](double x) {
+                if (high <= low) return size_t(0);
+                return min(histogram.size() - 1,
+                           static_cast<size_t>((x - low) / (high - low) * histogram.size()));
+            };
+            for_each_block([&](const Matrix<T>& block, size_t) {
+                for (size_t i = 0; i < block.size(); ++i) ++histogram[bin_of(block[i][split_dim])];
+            });
+            const auto bounds = plan_slabs(histogram, low, high, radius(), max_rows);
+            const auto n_slabs = bounds.size() - 1;
+
+            // spill each point to its own slab and the slabs it is a halo of
+            vector<string> id_files, row_files;
+            for (size_t slab = 0; slab < n_slabs; ++slab) {
+                id_files.emplace_back(tmp.file(to_string(slab) + ".ids"));
+                row_files.emplace_back(tmp.file(to_string(slab) + ".rows"));
+            }
+            // buffers of all slabs together hold up to block_rows rows
+            vector<vector<int>> id_buffers(n_slabs);
+            vector<vector<T>> row_buffers(n_slabs);
+            size_t n_buffered = 0;
+            const auto flush = [&]() {
+                for (size_t slab = 0; slab < n_slabs; ++slab) {
+                    if (id_buffers[slab].empty()) continue;
+                    append_to_file(id_files[slab], id_buffers[slab]);
+                    append_to_file(row_files[slab], row_buffers[slab]);
+                    id_buffers[slab].clear();
+                    row_buffers[slab].clear();
+                }
+                n_buffered = 0;
+            };
+            for_each_block([&](const Matrix<T>& block, size_t begin) {
+                for (size_t i = 0; i < block.size(); ++i) {
+                    const auto x = block[i][split_dim];
+                    // slabs (bounds[s] - eps, bounds[s + 1] + eps) holding x
+                    const size_t first = upper_bound(bounds.begin(), bounds.end(), x - radius()) - bounds.begin() - 1;
+                    const size_t last = lower_bound(bounds.begin(), bounds.end(), x + radius()) - bounds.begin();
+                    for (auto slab = first; slab < min(last, n_slabs); ++slab) {
+                        id_buffers[slab].emplace_back(begin + i);
+                        row_buffers[slab].insert(row_buffers[slab].end(),
+                                                 block.row_data(i), block.row_data(i) + dim);
+                        if (++n_buffered >= block_rows) flush();
+                    }
+                }
+            });
+            flush();
+
+            // f(ids, index, owned) for each slab in turn
+            const auto for_each_slab = [&](const function<void(const vector<int>&, const RangeIndex&,
+                                                              const vector<char>&)>& f) {
+                for (size_t slab = 0; slab < n_slabs; ++slab) {
+                    const auto ids = read_whole_file<int>(id_files[slab]);
+                    if (ids.empty()) continue;
+                    Matrix<T> points(ids.size(), dim);
+                    ifstream ifs(row_files[slab], ios::binary);
+                    if (!ifs.read(reinterpret_cast<char*>(points.data()), ids.size() * row_bytes))
+                        throw runtime_error("Can't read file!: " + row_files[slab]);
+                    vector<char> owned(ids.size());
+                    for (size_t i = 0; i < ids.size(); ++i) {
+                        const auto x = points[i][split_dim];
+                        owned[i] = bounds[slab] <= x && x < bounds[slab + 1];
+                    }
+                    const auto index = make_index(index_type, points, radius(), graph_params);
+                    f(ids, *index, owned);
+                }
+            };
+
+            vector<char> is_core(n_points);
+            for_each_slab([&](const vector<int>& ids, const RangeIndex& index, const vector<char>& owned) {
+#pragma omp parallel for schedule(dynamic, 64)
+                for (int i = 0; i < ids.size(); ++i) {
+                    if (owned[i]) is_core[ids[i]] = index.range_search(i, radius()).size() >= minpts;
+                }
+            });
+
+            ConcurrentUnionFind union_find(n_points);
+            for_each_slab([&](const vector<int>& ids, const RangeIndex& index, const vector<char>& owned) {
+#pragma omp parallel for schedule(dynamic, 64)
+                for (int i = 0; i < ids.size(); ++i) {
+                    if (!owned[i] || !is_core[ids[i]]) continue;
+                    for (const auto j : index.range_search(i, radius())) {
+                        if (is_core[ids[j]]) union_find.unite(ids[i], ids[j]);
+                    }
+                }
+            });
+
+            // clusters numbered by their smallest core point, as in fit
+            vector<int> root_labels(n_points, -1);
+            int n_clusters = 0;
+            for (int id = 0; id < n_points; ++id) {
+                if (is_core[id] && union_find.parent[id].load(memory_order_relaxed) == id)
+                    root_labels[id] = n_clusters++;
+            }
+            vector<int> labels(n_points, -1);
+#pragma omp parallel for
+            for (int id = 0; id < n_points; ++id) {
+                if (is_core[id]) labels[id] = root_labels[union_find.find(id)];
+            }
+            root_labels = vector<int>();
+
+            for_each_slab([&](const vector<int>& ids, const RangeIndex& index, const vector<char>& owned) {
+#pragma omp parallel for schedule(dynamic, 64)
+                for (int i = 0; i < ids.size(); ++i) {
+                    if (!owned[i] || is_core[ids[i]]) continue;
+                    auto label = numeric_limits<int>::max();
+                    for (const auto j : index.range_search(i, radius())) {
+                        if (is_core[ids[j]]) label = min(label, labels[ids[j]]);
+                    }
+                    if (label != numeric_limits<int>::max()) labels[ids[i]] = label;
+                }
+            });
+
+            database = BasicDatabase<T>();
+            database.cluster_ids = move(labels);
+            clusters = make_clusters(database.cluster_ids);
+            n_neighbors.clear();
+            removed.clear();
+            update_grid.reset();
+            model.reset();
+        }
+
+        // core, border or noise for every point; needs the neighbor counts
+        // that fit keeps, so not after fit_out_of_core
+        vector<PointKind> point_kinds() const {
+            const auto& labels = database.cluster_ids;
+            if (n_neighbors.size() != labels.size())
+                throw runtime_error("Point kinds are not available for this clustering!");
+            vector<PointKind> kinds(labels.size());
+#pragma omp parallel for
+            for (int id = 0; id < labels.size(); ++id) {
+                kinds[id] = labels[id] < 0 ? PointKind::noise
+                                           : is_core(id) ? PointKind::core : PointKind::border;
+            }
+            return kinds;
+        }
+
+        // the core points and their labels, for labeling new points without a
+        // refit; needs the neighbor counts of fit, so not after fit_out_of_core
+        BasicDBSCANModel<T, Metric> make_model() const {
+            if (n_neighbors.size() != database.size())
+                throw runtime_error("A model needs the neighbor counts of fit!");
+            vector<int> core_ids;
+            for (int id = 0; id < database.size(); ++id) {
+                if (is_core(id)) core_ids.emplace_back(id);
+            }
+            Matrix<T> core_points(core_ids.size(), database.dim());
+            vector<int32_t> labels(core_ids.size());
+#pragma omp parallel for
+            for (int i = 0; i < core_ids.size(); ++i) {
+                const auto row = database.points.row_data(core_ids[i]);
+                copy(row, row + database.dim(), core_points.row_data(i));
+                labels[i] = database.cluster_ids[core_ids[i]];
+            }
+            return BasicDBSCANModel<T, Metric>(eps, clusters.size(), core_points, move(labels));
+        }
+
+        // labels[i], the cluster of the nearest core point within eps of row
+        // i of batch or -1, for every row in parallel; labels must hold
+        // batch.size() ints. See BasicDBSCANModel.
+        void predict(const Matrix<T>& batch, int* labels) {
+            if (!model) model = make_shared<const BasicDBSCANModel<T, Metric>>(make_model());
+            model->predict(batch, labels);
+        }
+
+        vector<int> predict(const Matrix<T>& batch) {
+            vector<int> labels(batch.size());
+            predict(batch, labels.data());
+            return labels;
+        }
+
+        // a model file that BasicDBSCANModel<T, Metric>::load maps back in
+        void save_model(const string& path) const {
+            if (model) model->save(path);
+            else make_model().save(path);
+        }
+
+        // Writes the cluster id of every point with save_labels. with_kinds
+        // adds whether each point is core, border or noise.
+        void save(const string& save_path, bool with_kinds = false) const {
+            vector<PointKind> kinds;
+            if (with_kinds) kinds = point_kinds();
+            save_labels(save_path, database.cluster_ids, clusters.size(), with_kinds ? &kinds : nullptr);
+        }
+
+        // One csv line "cluster_id,size,member,member,..." per cluster, taken
+        // from clusters without another pass over the points.
+        void save_clusters(const string& save_path) const {
+            ofstream ofs(save_path);
+            if (!ofs) throw runtime_error("Can't open file!: " + save_path);
+            constexpr size_t block_size = 64;
+            write_blocks(ofs, (clusters.size() + block_size - 1) / block_size, [&](size_t block) {
+                string text;
+                for (auto c = block * block_size; c < min(clusters.size(), (block + 1) * block_size); ++c) {
+                    append_uint(text, c);
+                    text += ',';
+                    append_uint(text, clusters[c].size());
+                    for (const auto id : clusters[c]) {
+                        text += ',';
+                        append_uint(text, id);
+                    }
+                    text += '\n';
+                }
+                return text;
+            });
+            if (!ofs) throw runtime_error("Can't write file!: " + save_path);
         }
     };
+
+    using DBSCAN = BasicDBSCAN<double>;
 }
 
 #endif //DBSCAN_DBSCAN_HPP
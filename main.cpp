@@ -1,7 +1,251 @@
 #include <iostream>
 #include <dbscan.hpp>
 
-int main() {
-    std::cout << "Hello, World!" << std::endl;
+using namespace arailib;
+using namespace dbscan;
+
+const string usage = R"(usage: dbscan --data PATH --eps EPS --minpts MINPTS [options]
+       dbscan --model PATH --data PATH [--output PATH]
+
+input
+  --data PATH           csv file, directory of i.csv files, or binary dataset (.bin)
+  --n N                 rows to read from a csv file, or number of i.csv files
+                        in a directory (required for a directory)
+  --dtype TYPE          float64 (default) or float32 coordinates
+  --config PATH         json file with any of these settings, e.g. {"eps": 0.5};
+                        flags override it
+
+clustering
+  --eps EPS
+  --minpts MINPTS
+  --metric NAME         euclidean (default) or angular, acos(cosine) / pi in [0, 1]
+  --mode MODE           exact (default), approximate (NN-Descent graph) or cells
+                        (cell grid that counts neighbors only up to minpts)
+  --rho RHO             with --mode cells, connect core points up to eps * (1 + rho)
+  --index NAME          automatic, brute_force, grid, kd_tree, ball_tree, nn_descent,
+                        pivot (brute force pruned by a pivot table, for high dimensions),
+                        quantized (brute force over uint8 codes, exact rows near eps)
+  --graph PATH          take eps-neighborhoods from this proximity graph (approximate)
+  --degree K            graph degree for nn_descent, or edges kept per node of --graph
+  --memory-budget BYTES cluster out of core within this budget
+  --threads N           OpenMP threads (default: all)
+
+output
+  --output PATH         cluster id of every point, as csv or binary labels (.bin)
+  --kinds               also write whether each point is core, border or noise
+  --clusters PATH       members of every cluster as csv
+  --save-model PATH     core points and their clusters, for --model
+
+prediction
+  --model PATH          label the points of --data by a saved model instead of
+                        clustering them: the cluster of the nearest core point
+                        within eps, or -1 (--dtype and --metric as when saved)
+  --stats PATH          phase timings and counters as json
+  --quiet               do not print the summary
+)";
+
+// "--key value" and "--key=value" flags on top of the settings of --config;
+// a flag without a value is set to true
+json parse_args(int argc, char** argv) {
+    json flags;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) throw runtime_error("Unexpected argument!: " + arg);
+        arg = arg.substr(2);
+        const auto equal = arg.find('=');
+        if (equal != string::npos) flags[arg.substr(0, equal)] = arg.substr(equal + 1);
+        else if (i + 1 < argc && string(argv[i + 1]).compare(0, 2, "--") != 0) flags[arg] = argv[++i];
+        else flags[arg] = true;
+    }
+
+    json config;
+    if (flags.count("config")) config = read_config(flags["config"].get<string>());
+    for (auto it = flags.begin(); it != flags.end(); ++it) config[it.key()] = it.value();
+    return config;
+}
+
+string get_string(const json& config, const string& key, const string& default_value = "") {
+    if (!config.count(key)) return default_value;
+    const auto& value = config[key];
+    return value.is_string() ? value.get<string>() : value.dump();
+}
+
+double get_number(const json& config, const string& key, double default_value) {
+    if (!config.count(key)) return default_value;
+    const auto& value = config[key];
+    if (value.is_number()) return value.get<double>();
+    const auto text = get_string(config, key);
+    char* end;
+    const auto number = strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0') throw runtime_error("Invalid number for --" + key + "!: " + text);
+    return number;
+}
+
+// only true, from a bare flag or json, or the string "true" switches a flag on
+bool get_flag(const json& config, const string& key) {
+    if (!config.count(key)) return false;
+    const auto& value = config[key];
+    return value.is_boolean() ? value.get<bool>() : value.is_string() && value.get<string>() == "true";
+}
+
+IndexType parse_index_type(const string& name) {
+    const map<string, IndexType> types = {
+            {"automatic", IndexType::automatic}, {"brute_force", IndexType::brute_force},
+            {"grid", IndexType::grid}, {"kd_tree", IndexType::kd_tree},
+            {"ball_tree", IndexType::ball_tree}, {"nn_descent", IndexType::nn_descent},
+            {"pivot", IndexType::pivot}, {"quantized", IndexType::quantized}};
+    const auto it = types.find(name);
+    if (it == types.end()) throw runtime_error("Unknown index!: " + name);
+    return it->second;
+}
+
+template <typename T, typename Metric>
+void run(const json& config) {
+    const auto data_path = get_string(config, "data");
+    if (data_path.empty() || !config.count("eps") || !config.count("minpts"))
+        throw runtime_error("--data, --eps and --minpts are required");
+    const auto n = static_cast<int>(get_number(config, "n", -1));
+    const auto eps = get_number(config, "eps", 0);
+    const auto minpts = static_cast<int>(get_number(config, "minpts", 0));
+    const auto degree = static_cast<int>(get_number(config, "degree", -1));
+    const auto graph_path = get_string(config, "graph");
+
+    const auto mode = get_string(config, "mode", "exact");
+    if (mode != "exact" && mode != "approximate" && mode != "cells") throw runtime_error("Unknown mode!: " + mode);
+    auto index_type = parse_index_type(get_string(config, "index", "automatic"));
+    if (mode == "approximate") {
+        if (index_type != IndexType::automatic && index_type != IndexType::nn_descent)
+            throw runtime_error("--mode approximate builds its own index!: " + get_string(config, "index"));
+        index_type = IndexType::nn_descent;
+    }
+
+    const auto n_threads = static_cast<int>(get_number(config, "threads", 0));
+    if (n_threads > 0) omp_set_num_threads(n_threads);
+
+    FitStats stats;
+    BasicDBSCAN<T, Metric> dbscan(eps, minpts, index_type);
+    dbscan.stats = &stats;
+    if (degree > 0) dbscan.graph_params.degree = degree;
+
+    const auto start = get_now();
+    const auto memory_budget = get_number(config, "memory-budget", 0);
+    if (memory_budget > 0) {
+        dbscan.fit_out_of_core(data_path, static_cast<size_t>(memory_budget), n);
+        stats.add_phase("out_of_core", start);
+    }
+    else if (mode == "cells") {
+        const auto load_start = get_now();
+        const auto points = load_matrix<T>(data_path, n);
+        stats.add_phase("load", load_start);
+        dbscan.fit_cells(points, get_number(config, "rho", 0));
+    }
+    else if (!graph_path.empty()) {
+        const auto load_start = get_now();
+        const auto points = load_matrix<T>(data_path, n);
+        stats.add_phase("load", load_start);
+
+        BasicGraphIndex<T, Metric> graph;
+        graph.stats = &stats;
+        graph.load(points, graph_path, n, degree);
+        dbscan.fit_prepared(graph.points, graph.self_range_search_all(eps));
+    }
+    else {
+        dbscan.fit(data_path, n);
+    }
+    stats.add_phase("total", start);
+
+    const auto output_path = get_string(config, "output");
+    if (!output_path.empty()) {
+        const auto save_start = get_now();
+        dbscan.save(output_path, get_flag(config, "kinds"));
+        stats.add_phase("save", save_start);
+    }
+
+    const auto clusters_path = get_string(config, "clusters");
+    if (!clusters_path.empty()) dbscan.save_clusters(clusters_path);
+
+    const auto model_path = get_string(config, "save-model");
+    if (!model_path.empty()) dbscan.save_model(model_path);
+
+    const auto stats_path = get_string(config, "stats");
+    if (!stats_path.empty()) {
+        ofstream ofs(stats_path);
+        if (!ofs) throw runtime_error("Can't open file!: " + stats_path);
+        ofs << stats.to_json().dump(2) << endl;
+    }
+
+    if (get_flag(config, "quiet")) return;
+    cerr << "points:   " << dbscan.database.cluster_ids.size() << endl
+         << "clusters: " << dbscan.clusters.size() << endl;
+    if (memory_budget <= 0) {
+        cerr << "core:     " << stats.n_core << endl
+             << "border:   " << stats.n_border << endl
+             << "noise:    " << stats.n_noise << endl;
+    }
+    for (const auto& phase : stats.phase_seconds) {
+        cerr << phase.first << ": " << phase.second << " s" << endl;
+    }
+}
+
+template <typename T, typename Metric>
+void run_predict(const json& config) {
+    const auto data_path = get_string(config, "data");
+    if (data_path.empty()) throw runtime_error("--data is required");
+    const auto n_threads = static_cast<int>(get_number(config, "threads", 0));
+    if (n_threads > 0) omp_set_num_threads(n_threads);
+
+    FitStats stats;
+    auto start = get_now();
+    const auto model = BasicDBSCANModel<T, Metric>::load(get_string(config, "model"));
+    stats.add_phase("load_model", start);
+    start = get_now();
+    const auto points = load_matrix<T>(data_path, static_cast<int>(get_number(config, "n", -1)));
+    stats.add_phase("load", start);
+    start = get_now();
+    vector<int> labels(points.size());
+    model.predict(points, labels.data());
+    stats.add_phase("predict", start);
+
+    const auto output_path = get_string(config, "output");
+    if (!output_path.empty()) {
+        start = get_now();
+        save_labels(output_path, labels, model.n_clusters);
+        stats.add_phase("save", start);
+    }
+
+    if (get_flag(config, "quiet")) return;
+    cerr << "points:   " << labels.size() << endl
+         << "noise:    " << count(labels.begin(), labels.end(), -1) << endl;
+    for (const auto& phase : stats.phase_seconds) {
+        cerr << phase.first << ": " << phase.second << " s" << endl;
+    }
+}
+
+template <typename T>
+void run_with_metric(const json& config) {
+    const auto metric = get_string(config, "metric", "euclidean");
+    const auto predict = config.count("model") > 0;
+    if (metric == "euclidean") predict ? run_predict<T, Euclidean>(config) : run<T, Euclidean>(config);
+    else if (metric == "angular") predict ? run_predict<T, Angular>(config) : run<T, Angular>(config);
+    else throw runtime_error("Unknown metric!: " + metric);
+}
+
+int main(int argc, char** argv) {
+    try {
+        const auto config = parse_args(argc, argv);
+        if (argc == 1 || config.count("help")) {
+            cout << usage;
+            return 0;
+        }
+
+        const auto dtype = get_string(config, "dtype", "float64");
+        if (dtype == "float64") run_with_metric<double>(config);
+        else if (dtype == "float32") run_with_metric<float>(config);
+        else throw runtime_error("Unknown dtype!: " + dtype);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
     return 0;
 }
@@ -1,3 +1,4 @@
+#include <random>
 #include <gtest/gtest.h>
 #include <arailib.hpp>
 #include <dbscan.hpp>
@@ -5,8 +6,13 @@
 using namespace arailib;
 using namespace dbscan;
 
+// set by CMake to the directory of this file
+#ifndef TEST_DATA_DIR
+#define TEST_DATA_DIR "test/src/"
+#endif
+
 TEST(dbscan, small) {
-    string data_path = "/tmp/tmp.VzjXG3U2nU/test/src/data1.csv";
+    string data_path = string(TEST_DATA_DIR) + "data1.csv";
     double eps = 1.5;
     int minpts = 2;
 
@@ -37,7 +43,7 @@ TEST(dbscan, moon) {
 }
 
 TEST(dbscan, small_with_graph) {
-    string base_dir = "/tmp/tmp.VzjXG3U2nU/test/src/";
+    string base_dir = TEST_DATA_DIR;
     string data_path = base_dir + "data1.csv";
     string graph_path = base_dir + "graph1.csv";
 
@@ -50,8 +56,8 @@ TEST(dbscan, small_with_graph) {
     graph.load(data_path, graph_path);
 
     vector<vector<int>> eps_neighbors_list;
-    for (const auto node : graph.nodes) {
-        const auto eps_neighbor = graph.self_range_search(node.data.id, eps);
+    for (int id = 0; id < graph.size(); ++id) {
+        const auto eps_neighbor = graph.self_range_search(id, eps);
         eps_neighbors_list.emplace_back(eps_neighbor);
     }
 
@@ -64,4 +70,977 @@ TEST(dbscan, small_with_graph) {
     ASSERT_EQ(dbscan.database[0].cluster_id, 0);
     ASSERT_EQ(dbscan.database[1].cluster_id, 1);
     ASSERT_EQ(dbscan.database[10].cluster_id, -1);
-}
\ No newline at end of file
+}
+
+TEST(dbscan, grid_index) {
+    mt19937 engine(42);
+    normal_distribution<double> dist(0, 1);
+    Dataset<> dataset;
+    for (size_t i = 0; i < 500; ++i) {
+        dataset.emplace_back(i, vector<double>{dist(engine), dist(engine), dist(engine)});
+    }
+
+    double eps = 0.5;
+    int minpts = 4;
+
+    auto dbscan = DBSCAN(eps, minpts);
+    dbscan.fit(dataset);
+
+    const GridIndex grid(dbscan.database.points, eps);
+    for (int id = 0; id < dataset.size(); ++id) {
+        ASSERT_EQ(grid.range_search(id, eps), dbscan.scan_eps_neighbors(id));
+    }
+
+    auto brute_force = DBSCAN(eps, minpts, IndexType::brute_force);
+    brute_force.fit(dataset);
+
+    ASSERT_EQ(dbscan.clusters, brute_force.clusters);
+    for (int id = 0; id < dataset.size(); ++id) {
+        ASSERT_EQ(dbscan.database[id].cluster_id, brute_force.database[id].cluster_id);
+    }
+
+    // eps = 0 reaches the grid through automatic index selection
+    auto zero = DBSCAN(0, minpts);
+    zero.fit(dataset);
+    ASSERT_TRUE(zero.clusters.empty());
+    const GridIndex single_cell(dbscan.database.points, 0);
+    for (int id = 0; id < dataset.size(); ++id) {
+        ASSERT_EQ(single_cell.range_search(id, eps), dbscan.scan_eps_neighbors(id));
+        ASSERT_TRUE(single_cell.range_search(id, 0).empty());
+    }
+}
+
+TEST(dbscan, tree_index) {
+    mt19937 engine(0);
+    normal_distribution<double> dist(0, 1);
+    Dataset<> dataset;
+    for (size_t i = 0; i < 1000; ++i) {
+        vector<double> x(8);
+        for (auto& xi : x) xi = dist(engine);
+        dataset.emplace_back(i, x);
+    }
+
+    double eps = 2.0;
+    int minpts = 5;
+
+    auto brute_force = DBSCAN(eps, minpts, IndexType::brute_force);
+    brute_force.fit(dataset);
+
+    const KDTree kd_tree(brute_force.database.points);
+    const BallTree ball_tree(brute_force.database.points);
+    for (int id = 0; id < dataset.size(); ++id) {
+        const auto expected = brute_force.scan_eps_neighbors(id);
+        ASSERT_EQ(kd_tree.range_search(id, eps), expected);
+        ASSERT_EQ(ball_tree.range_search(id, eps), expected);
+    }
+
+    for (const auto index_type : {IndexType::kd_tree, IndexType::ball_tree}) {
+        auto dbscan = DBSCAN(eps, minpts, index_type);
+        dbscan.fit(dataset);
+        ASSERT_EQ(dbscan.clusters, brute_force.clusters);
+    }
+}
+
+TEST(arailib, matrix) {
+    const Dataset<> dataset = {Data<>(0, {0, 1}), Data<>(1, {2, 4}), Data<>(2, {3, 3})};
+    const auto matrix = to_matrix<float>(dataset);
+
+    ASSERT_EQ(matrix.size(), 3);
+    ASSERT_EQ(matrix.dim, 2);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(matrix.data()) % 64, 0);
+    ASSERT_EQ(matrix[1][1], 4.0f);
+    ASSERT_EQ(matrix.row_data(2), matrix.data() + 4);
+    ASSERT_EQ(euclidean_distance(matrix[1], dataset[2]), euclidean_distance(dataset[1], dataset[2]));
+
+    const auto copy = matrix;
+    ASSERT_EQ(copy.data(), matrix.data());
+}
+
+TEST(arailib, squared_l2_kernels) {
+    mt19937 engine(1);
+    uniform_real_distribution<double> dist(-1, 1);
+    vector<double> a(300), b(300);
+    for (auto& x : a) x = dist(engine);
+    for (auto& x : b) x = dist(engine);
+    const vector<float> af(a.begin(), a.end()), bf(b.begin(), b.end());
+
+    for (const auto level : {SimdLevel::scalar, SimdLevel::avx2, SimdLevel::avx512}) {
+        if (level > simd_level()) continue;
+        for (size_t dim = 0; dim <= 37; ++dim) {
+            ASSERT_NEAR(squared_l2_kernel<double>(level)(a.data(), b.data(), dim),
+                        squared_l2_scalar(a.data(), b.data(), dim), 1e-9);
+            ASSERT_NEAR(squared_l2_kernel<float>(level)(af.data(), bf.data(), dim),
+                        squared_l2_scalar(af.data(), bf.data(), dim), 1e-4);
+        }
+
+        // the tile kernel must agree bit for bit with the pairwise kernel
+        const size_t dim = 10;
+        vector<double> out(29);
+        squared_l2_tile_kernel<double>(level)(a.data(), b.data(), out.size(), dim, out.data());
+        for (size_t r = 0; r < out.size(); ++r) {
+            ASSERT_EQ(out[r], squared_l2_kernel<double>(level)(a.data(), b.data() + r * dim, dim));
+        }
+    }
+}
+
+TEST(dbscan, parallel_labeling) {
+    // 0, 1, 2 and 5, 6 are core points, 3 is a border point shared by both
+    // clusters, 4, 8 and 9 are border points of one cluster and 7 is noise
+    const vector<vector<int>> eps_neighbors_list = {
+            {1, 2, 4}, {0, 2, 4}, {0, 1, 3}, {2, 5}, {0, 1},
+            {3, 6, 8}, {5, 8, 9}, {}, {5, 6}, {6}};
+    const auto labels = label_clusters(
+            eps_neighbors_list.size(), 3,
+            [&](int id) -> const vector<int>& { return eps_neighbors_list[id]; });
+    ASSERT_EQ(labels, vector<int>({0, 0, 0, 0, 0, 1, 1, -1, 1, 1}));
+    ASSERT_EQ(make_clusters(labels), Clusters({{0, 1, 2, 3, 4}, {5, 6, 8, 9}}));
+
+    mt19937 engine(7);
+    uniform_real_distribution<double> dist(0, 10);
+    Dataset<> dataset;
+    for (size_t i = 0; i < 3000; ++i) {
+        dataset.emplace_back(i, vector<double>{dist(engine), dist(engine)});
+    }
+
+    vector<vector<int>> results;
+    for (const auto n_threads : {1, 2, 8}) {
+        omp_set_num_threads(n_threads);
+        auto dbscan = DBSCAN(0.25, 4);
+        dbscan.fit(dataset);
+        results.emplace_back(dbscan.database.cluster_ids);
+    }
+    omp_set_num_threads(n_max_threads);
+
+    ASSERT_EQ(results[0], results[1]);
+    ASSERT_EQ(results[0], results[2]);
+}
+
+TEST(dbscan, neighbor_table) {
+    mt19937 engine(3);
+    uniform_real_distribution<double> dist(0, 10);
+    Dataset<> dataset;
+    for (size_t i = 0; i < 2500; ++i) {
+        dataset.emplace_back(i, vector<double>{dist(engine), dist(engine)});
+    }
+    const auto points = to_matrix(dataset);
+
+    auto dbscan = DBSCAN(0.3, 4);
+    const auto table = dbscan.compute_eps_neighbors(points);
+    const DeltaNeighborTable delta_table(table);
+    const BruteForceIndex brute_force(points);
+
+    vector<vector<int>> eps_neighbors_list;
+    ASSERT_EQ(table.size(), points.size());
+    for (int id = 0; id < points.size(); ++id) {
+        const auto expected = brute_force.range_search(id, 0.3);
+        ASSERT_EQ(vector<int>(table[id].begin(), table[id].end()), expected);
+        ASSERT_EQ(vector<int>(delta_table[id].begin(), delta_table[id].end()), expected);
+        eps_neighbors_list.emplace_back(expected);
+    }
+    ASSERT_LT(delta_table.memory_usage(), table.memory_usage());
+
+    dbscan.fit(points, table);
+    const auto labels = dbscan.database.cluster_ids;
+    dbscan.fit(points, delta_table);
+    ASSERT_EQ(dbscan.database.cluster_ids, labels);
+    dbscan.fit(dataset, eps_neighbors_list);
+    ASSERT_EQ(dbscan.database.cluster_ids, labels);
+    dbscan.fit(points, NeighborTable<uint32_t>(eps_neighbors_list));
+    ASSERT_EQ(dbscan.database.cluster_ids, labels);
+}
+
+TEST(arailib, binary_dataset) {
+    string base_dir = TEST_DATA_DIR;
+    string data_path = base_dir + "data1.csv";
+    string binary_path = "/tmp/dbscan_test_data1.bin";
+
+    convert_to_binary<float>(data_path, binary_path);
+    const auto matrix = load_binary<float>(binary_path);
+    const auto dataset = load_data(data_path, -1);
+    ASSERT_EQ(matrix.size(), dataset.size());
+    ASSERT_EQ(matrix.dim, dataset[0].size());
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(matrix.data()) % 64, 0);
+    for (size_t i = 0; i < dataset.size(); ++i) {
+        ASSERT_EQ(vector<float>(matrix[i].begin(), matrix[i].end()),
+                  vector<float>(dataset[i].begin(), dataset[i].end()));
+    }
+
+    auto dbscan = DBSCAN(1.5, 2);
+    dbscan.fit(binary_path);
+    auto expected = DBSCAN(1.5, 2);
+    expected.fit(data_path);
+    ASSERT_EQ(dbscan.database.cluster_ids, expected.database.cluster_ids);
+
+    save_binary(to_matrix(dataset), binary_path);
+    ASSERT_EQ(load_binary<double>(binary_path)[3][1], dataset[3][1]);
+}
+
+TEST(arailib, parallel_csv) {
+    const string csv_path = "/tmp/dbscan_test_parallel.csv";
+    {
+        ofstream ofs(csv_path);
+        ofs << "x,y\n";
+        for (int i = 0; i < 10000; ++i) {
+            ofs << i << ',' << i * 0.5 << (i % 7 == 0 ? "\r\n" : "\n");
+            if (i % 1000 == 0) ofs << '\n';
+        }
+    }
+
+    const auto matrix = read_csv_matrix<>(csv_path, -1, true);
+    ASSERT_EQ(matrix.size(), 10000);
+    ASSERT_EQ(matrix.dim, 2);
+    for (size_t i = 0; i < matrix.size(); ++i) {
+        ASSERT_EQ(matrix[i][0], i);
+        ASSERT_EQ(matrix[i][1], i * 0.5);
+    }
+    ASSERT_EQ(read_csv_matrix<>(csv_path, 10, true).size(), 10);
+    ASSERT_EQ(read_csv<float>(csv_path, 3, true)[2][1], 1.0f);
+
+    const string dir_path = "/tmp/dbscan_test_parallel_dir";
+    mkdir(dir_path.c_str(), 0755);
+    for (int file = 0; file < 3; ++file) {
+        ofstream ofs(dir_path + "/" + to_string(file) + ".csv");
+        for (int id = file; id < 30; id += 3) ofs << id << ',' << id * 2 << ',' << -id << '\n';
+    }
+    const auto dataset = load_data(dir_path, 3);
+    ASSERT_EQ(dataset.size(), 30);
+    ASSERT_EQ(dataset[17].id, 17);
+    ASSERT_EQ(dataset[17][0], 34);
+    ASSERT_EQ(dataset[17][1], -17);
+
+    // ids are integers even when coordinates are float, which can't hold 2^24 + 1
+    {
+        ofstream ofs(dir_path + "/0.csv");
+        ofs << "16777217,1\n16777218,2\n16777219,3\n";
+    }
+    const auto large_ids = read_csv_dir_matrix<float>(dir_path, 1);
+    ASSERT_EQ(large_ids.size(), 16777220);
+    ASSERT_EQ(large_ids[16777216][0], 0);
+    ASSERT_EQ(large_ids[16777217][0], 1);
+    ASSERT_EQ(large_ids[16777218][0], 2);
+    ASSERT_EQ(large_ids[16777219][0], 3);
+    for (const auto line : {"1.5,2\n", "-1,2\n", "99999999999999999999,2\n", "1e3,2\n"}) {
+        ofstream(dir_path + "/0.csv") << line;
+        ASSERT_THROW(read_csv_dir_matrix<float>(dir_path, 1), runtime_error);
+        ASSERT_THROW(convert_to_binary<float>(dir_path, "/tmp/dbscan_test_parallel_dir.bin", 1), runtime_error);
+    }
+    {
+        ofstream ofs(dir_path + "/0.csv");
+        ofs << "16777217,1\n16777219,3\n";
+    }
+    convert_to_binary<float>(dir_path, "/tmp/dbscan_test_parallel_dir.bin", 1);
+    const auto converted = load_binary<float>("/tmp/dbscan_test_parallel_dir.bin");
+    ASSERT_EQ(converted.size(), 16777220);
+    ASSERT_EQ(converted[16777217][0], 1);
+    ASSERT_EQ(converted[16777219][0], 3);
+    ASSERT_THROW(convert_to_binary<float>(dir_path, "/tmp/dbscan_test_parallel_dir.bin"), runtime_error);
+
+    {
+        ofstream ofs(csv_path);
+        ofs << "1,2\n3,4\n5,\n7,8\n";
+    }
+    ASSERT_THROW(read_csv_matrix<>(csv_path), runtime_error);
+}
+
+TEST(dbscan, graph_builder) {
+    const auto points = to_matrix(Dataset<>(
+            {Data<>(0, {0}), Data<>(1, {1}), Data<>(2, {2}), Data<>(3, {3})}));
+
+    GraphBuilder builder(points.size());
+    builder.add_edges({{0, 1}, {0, 1}, {0, 2}, {1, 1}});
+    builder.add_edges({{3, 2}, {0, 2}});
+
+    auto graph = builder.build(points);
+    ASSERT_EQ(graph.size(), 4);
+    ASSERT_EQ(graph.n_edges(), 3);
+    ASSERT_EQ(vector<int>(graph[0].begin(), graph[0].end()), vector<int>({1, 2}));
+    ASSERT_EQ(graph.n_neighbors(1), 0);
+    ASSERT_EQ(graph.points.data(), points.data());
+
+    graph.make_bidirectional();
+    ASSERT_EQ(vector<int>(graph[1].begin(), graph[1].end()), vector<int>({0}));
+    ASSERT_EQ(vector<int>(graph[2].begin(), graph[2].end()), vector<int>({0, 3}));
+    ASSERT_EQ(graph.n_edges(), 6);
+    ASSERT_EQ(builder.build(points, true).adjacency.indices, graph.adjacency.indices);
+}
+
+TEST(dbscan, graph_io) {
+    string base_dir = TEST_DATA_DIR;
+    string data_path = base_dir + "data1.csv";
+    string graph_path = base_dir + "graph1.csv";
+
+    GraphIndex graph;
+    graph.load(data_path, graph_path);
+    graph.make_bidirectional();
+
+    const string dir_path = "/tmp/dbscan_test_graph_dir";
+    mkdir(dir_path.c_str(), 0755);
+    for (const auto& save_path : {string("/tmp/dbscan_test_graph.csv"),
+                                  string("/tmp/dbscan_test_graph.bin"), dir_path}) {
+        graph.save(save_path);
+
+        GraphIndex loaded;
+        loaded.load(graph.points, save_path, 1);
+        ASSERT_EQ(loaded.adjacency.offsets, graph.adjacency.offsets);
+        ASSERT_EQ(loaded.adjacency.indices, graph.adjacency.indices);
+    }
+
+    GraphIndex limited;
+    limited.load(graph.points, "/tmp/dbscan_test_graph.csv", 1, 2);
+    for (size_t id = 0; id < limited.size(); ++id) ASSERT_LE(limited.n_neighbors(id), 2);
+
+    // the degree cap keeps the first distinct neighbors in file order, however
+    // the lines of a node are spread over the chunks parsed in parallel
+    {
+        const size_t n = 500, degree = 3;
+        Matrix<> points(n, 2);
+        mt19937 engine(47);
+        uniform_int_distribution<int> node(0, n - 1);
+        vector<vector<int>> expected(n);
+        ofstream ofs("/tmp/dbscan_test_graph_degree.csv");
+        for (int line = 0; line < 20000; ++line) {
+            const int from = node(engine), to = line % 7 == 0 && !expected[from].empty()
+                                                ? expected[from][0] : node(engine);
+            ofs << from << ',' << to << '\n';
+            auto& kept = expected[from];
+            if (to != from && kept.size() < degree && find(kept.begin(), kept.end(), to) == kept.end())
+                kept.emplace_back(to);
+        }
+        ofs.close();
+        for (auto& kept : expected) sort(kept.begin(), kept.end());
+
+        GraphIndex capped;
+        capped.load(points, "/tmp/dbscan_test_graph_degree.csv", 1, degree);
+        for (size_t id = 0; id < n; ++id) {
+            ASSERT_EQ(vector<int>(capped[id].begin(), capped[id].end()), expected[id]);
+        }
+
+        // a binary graph is capped the same way, by its stored order
+        GraphIndex full;
+        full.load(points, "/tmp/dbscan_test_graph_degree.csv", 1);
+        full.save("/tmp/dbscan_test_graph_degree.bin");
+        GraphIndex capped_binary;
+        capped_binary.load(points, "/tmp/dbscan_test_graph_degree.bin", 1, degree);
+        for (size_t id = 0; id < n; ++id) {
+            const auto row = full[id];
+            ASSERT_EQ(vector<int>(capped_binary[id].begin(), capped_binary[id].end()),
+                      vector<int>(row.begin(), row.begin() + min<size_t>(degree, row.size())));
+        }
+
+        // a degree beyond every row keeps the whole graph
+        GraphIndex uncapped;
+        uncapped.load(points, "/tmp/dbscan_test_graph_degree.bin", 1, 1 << 30);
+        ASSERT_EQ(uncapped.adjacency.indices, full.adjacency.indices);
+
+        // truncated or corrupt binary graphs are rejected, not read out of bounds
+        ifstream ifs("/tmp/dbscan_test_graph_degree.bin", ios::binary);
+        const string bytes((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+        const auto indices_begin = sizeof(GraphHeader) + (n + 1) * sizeof(uint64_t);
+        const auto write_broken = [&](const string& broken) {
+            ofstream("/tmp/dbscan_test_graph_broken.bin", ios::binary) << broken;
+        };
+        write_broken(bytes.substr(0, bytes.size() - 1));
+        ASSERT_THROW(capped.load(points, "/tmp/dbscan_test_graph_broken.bin", 1), runtime_error);
+        auto broken = bytes;
+        const int bad_id = n;
+        memcpy(&broken[indices_begin + 5 * sizeof(int)], &bad_id, sizeof(int));
+        write_broken(broken);
+        ASSERT_THROW(capped.load(points, "/tmp/dbscan_test_graph_broken.bin", 1), runtime_error);
+        broken = bytes;
+        const uint64_t bad_offset = full.adjacency.indices.size() + 1;
+        memcpy(&broken[sizeof(GraphHeader) + 7 * sizeof(uint64_t)], &bad_offset, sizeof(uint64_t));
+        write_broken(broken);
+        ASSERT_THROW(capped.load(points, "/tmp/dbscan_test_graph_broken.bin", 1), runtime_error);
+    }
+
+    {
+        ofstream ofs("/tmp/dbscan_test_graph_broken.csv");
+        ofs << "0,1\n1,x\n";
+    }
+    ASSERT_THROW(limited.load(graph.points, "/tmp/dbscan_test_graph_broken.csv", 1), runtime_error);
+}
+
+TEST(dbscan, self_range_search_all) {
+    mt19937 engine(5);
+    uniform_real_distribution<double> dist(0, 10);
+    Dataset<> dataset;
+    for (size_t i = 0; i < 400; ++i) {
+        dataset.emplace_back(i, vector<double>{dist(engine), dist(engine)});
+    }
+    const auto points = to_matrix(dataset);
+
+    // on a complete graph the traversal must find the exact eps-neighborhoods
+    GraphBuilder builder(points.size());
+    for (int i = 0; i < points.size(); ++i) {
+        vector<pair<int, int>> edges;
+        for (int j = 0; j < points.size(); ++j) edges.emplace_back(i, j);
+        builder.add_edges(edges);
+    }
+    const auto graph = builder.build(points);
+
+    const double eps = 0.8;
+    const auto table = graph.self_range_search_all(eps);
+    const BruteForceIndex brute_force(points);
+    for (int id = 0; id < points.size(); ++id) {
+        const auto expected = brute_force.range_search(id, eps);
+        ASSERT_EQ(vector<int>(table[id].begin(), table[id].end()), expected);
+
+        auto result = graph.self_range_search(id, eps);
+        sort(result.begin(), result.end());
+        ASSERT_EQ(result, expected);
+    }
+
+    auto dbscan = DBSCAN(eps, 4);
+    dbscan.fit(points, table);
+    auto expected = DBSCAN(eps, 4);
+    expected.fit(points);
+    ASSERT_EQ(dbscan.clusters, expected.clusters);
+}
+
+TEST(dbscan, nn_descent) {
+    mt19937 engine(11);
+    normal_distribution<double> dist(0, 1);
+    Dataset<> dataset;
+    for (size_t i = 0; i < 2000; ++i) {
+        vector<double> x(16);
+        for (auto& xi : x) xi = dist(engine) + (i % 4) * 4;
+        dataset.emplace_back(i, x);
+    }
+    const auto points = to_matrix(dataset);
+
+    NNDescentParams params;
+    params.degree = 16;
+    const auto graph = build_nn_descent_graph(points, params);
+    ASSERT_EQ(graph.size(), points.size());
+    ASSERT_GE(graph.n_neighbors(0), 16);
+
+    const double eps = 4.5;
+    const auto exact = DBSCAN(eps, 5, IndexType::brute_force).compute_eps_neighbors(points);
+    const auto approximate = graph.self_range_search_all(eps);
+    ASSERT_GT(eps_neighborhood_recall(approximate, exact), 0.9);
+    ASSERT_EQ(eps_neighborhood_recall(exact, exact), 1.0);
+
+    auto dbscan = DBSCAN(eps, 5, IndexType::nn_descent);
+    dbscan.graph_params = params;
+    dbscan.fit(points);
+    ASSERT_EQ(dbscan.clusters.size(), 4);
+}
+
+TEST(dbscan, incremental) {
+    // core points and noise must match a refit; border points only have to
+    // sit in a cluster the refit also puts them in some cluster of
+    const auto expect_refit = [](const DBSCAN& dbscan, const vector<int>& ids) {
+        Matrix<> points(ids.size(), dbscan.database.dim());
+        for (int i = 0; i < ids.size(); ++i) {
+            const auto row = dbscan.database.points.row_data(ids[i]);
+            copy(row, row + points.dim, points.row_data(i));
+        }
+        auto refit = DBSCAN(dbscan.eps, dbscan.minpts);
+        refit.fit(points);
+        for (int i = 0; i < ids.size(); ++i) {
+            const auto label = dbscan.database.cluster_ids[ids[i]];
+            const auto expected = refit.database.cluster_ids[i];
+            if (refit.is_core(i)) ASSERT_EQ(label, expected);
+            else ASSERT_EQ(label < 0, expected < 0);
+        }
+        ASSERT_EQ(dbscan.clusters.size(), refit.clusters.size());
+    };
+
+    for (const size_t dim : {2, 5}) {
+        mt19937 engine(13);
+        uniform_real_distribution<double> dist(0, 10);
+        Matrix<> points(1200, dim);
+        for (size_t i = 0; i < points.size() * dim; ++i) points.data()[i] = dist(engine);
+
+        const double eps = dim == 2 ? 0.4 : 2.2;
+        auto dbscan = DBSCAN(eps, 4);
+        dbscan.fit(points);
+
+        // grow the database in batches
+        const size_t batch = 200;
+        for (size_t begin = 0; begin < points.size(); begin += batch) {
+            Matrix<> rows(batch, dim);
+            for (size_t i = 0; i < batch * dim; ++i) rows.data()[i] = dist(engine);
+            ASSERT_EQ(dbscan.insert(rows), points.size() + begin);
+        }
+        vector<int> live(dbscan.database.size());
+        iota(live.begin(), live.end(), 0);
+        expect_refit(dbscan, live);
+
+        // then shrink it again
+        shuffle(live.begin(), live.end(), engine);
+        for (int round = 0; round < 4; ++round) {
+            dbscan.remove(vector<int>(live.end() - 300, live.end()));
+            live.resize(live.size() - 300);
+            sort(live.begin(), live.end());
+            expect_refit(dbscan, live);
+            shuffle(live.begin(), live.end(), engine);
+        }
+        for (const auto& cluster : dbscan.clusters) {
+            for (const auto id : cluster) ASSERT_FALSE(dbscan.removed[id]);
+        }
+    }
+}
+
+TEST(dbscan, out_of_core) {
+    mt19937 engine(17);
+    normal_distribution<double> dist(0, 0.6);
+    Matrix<> points(3000, 2);
+    for (size_t i = 0; i < points.size(); ++i) {
+        points.row_data(i)[0] = dist(engine) + (i % 5) * 3;
+        points.row_data(i)[1] = dist(engine) + (i % 3) * 2;
+    }
+    const string binary_path = "/tmp/dbscan_test_out_of_core.bin";
+    save_binary(points, binary_path);
+    const string csv_path = "/tmp/dbscan_test_out_of_core.csv";
+    {
+        ofstream ofs(csv_path);
+        ofs.precision(17);
+        for (size_t i = 0; i < points.size(); ++i) ofs << points[i][0] << ',' << points[i][1] << '\n';
+    }
+
+    auto expected = DBSCAN(0.3, 5);
+    expected.fit(points);
+
+    // budgets from one slab down to slabs smaller than their halos
+    for (const size_t memory_budget : {size_t(1) << 26, size_t(64) << 10, size_t(8) << 10}) {
+        auto dbscan = DBSCAN(0.3, 5);
+        dbscan.fit_out_of_core(binary_path, memory_budget);
+        ASSERT_EQ(dbscan.database.cluster_ids, expected.database.cluster_ids);
+        ASSERT_EQ(dbscan.clusters, expected.clusters);
+    }
+
+    auto from_csv = DBSCAN(0.3, 5);
+    from_csv.fit_out_of_core(csv_path, size_t(16) << 10);
+    ASSERT_EQ(from_csv.database.cluster_ids, expected.database.cluster_ids);
+
+    // n of a directory counts its i.csv files, not rows
+    const string dir_path = "/tmp/dbscan_test_out_of_core_dir";
+    mkdir(dir_path.c_str(), 0755);
+    const int n_files = 10;
+    {
+        vector<ofstream> files;
+        for (int i = 0; i < n_files; ++i) files.emplace_back(dir_path + "/" + to_string(i) + ".csv");
+        for (size_t i = 0; i < points.size(); ++i) {
+            auto& ofs = files[i % n_files];
+            ofs.precision(17);
+            ofs << i << ',' << points[i][0] << ',' << points[i][1] << '\n';
+        }
+    }
+    auto in_memory = DBSCAN(0.3, 5);
+    in_memory.fit(dir_path, n_files);
+    auto from_dir = DBSCAN(0.3, 5);
+    from_dir.fit_out_of_core(dir_path, size_t(16) << 10, n_files);
+    ASSERT_EQ(from_dir.database.cluster_ids.size(), points.size());
+    ASSERT_EQ(from_dir.database.cluster_ids, in_memory.database.cluster_ids);
+    ASSERT_EQ(from_dir.database.cluster_ids, expected.database.cluster_ids);
+
+    // the points stay on disk, so there is nothing to update in place
+    ASSERT_THROW(from_csv.insert(points), runtime_error);
+    ASSERT_THROW(from_csv.remove({0}), runtime_error);
+    ASSERT_EQ(from_csv.database.cluster_ids, expected.database.cluster_ids);
+}
+
+TEST(dbscan, parameter_sweep) {
+    mt19937 engine(19);
+    normal_distribution<double> dist(0, 0.5);
+    Matrix<> points(1500, 3);
+    for (size_t i = 0; i < points.size(); ++i) {
+        for (size_t d = 0; d < 3; ++d) points.row_data(i)[d] = dist(engine) + (i % 4) * (d + 1);
+    }
+
+    const vector<double> eps_values = {0.2, 0.35, 0.5};
+    const vector<int> minpts_values = {3, 8};
+    const auto results = sweep_parameters(points, eps_values, minpts_values);
+    ASSERT_EQ(results.size(), eps_values.size() * minpts_values.size());
+    for (const auto& result : results) {
+        auto dbscan = DBSCAN(result.eps, result.minpts);
+        dbscan.fit(points);
+        ASSERT_EQ(result.labels, dbscan.database.cluster_ids);
+        ASSERT_EQ(result.n_clusters, dbscan.clusters.size());
+        ASSERT_EQ(result.n_core + result.n_border + result.n_noise, points.size());
+    }
+
+    const auto index = make_index(IndexType::brute_force, points, 0.5, NNDescentParams());
+    const SweepNeighbors neighbors(*index, points, 0.5);
+    for (int id = 0; id < points.size(); ++id) {
+        const auto core_distance = neighbors.core_distance(id, 3);
+        ASSERT_EQ(core_distance < 0.35, neighbors.within(id, 0.35).size() >= 3);
+    }
+}
+
+TEST(dbscan, float_points) {
+    // coordinates on a grid of 1/8 are exact in float, so both scalar types
+    // must see exactly the same neighborhoods
+    mt19937 engine(23);
+    uniform_int_distribution<int> dist(0, 40);
+    for (const size_t dim : {2, 3, 5, 8}) {
+        Matrix<> points(800, dim);
+        for (size_t i = 0; i < points.size() * dim; ++i) points.data()[i] = dist(engine) / 8.0;
+        Matrix<float> float_points(points.size(), dim);
+        copy(points.data(), points.data() + points.size() * dim, float_points.data());
+
+        const double eps = 0.3 * dim;
+        for (const auto type : {IndexType::brute_force, IndexType::grid, IndexType::kd_tree,
+                                IndexType::ball_tree}) {
+            if (type == IndexType::grid && dim > 5) continue;
+            auto expected = DBSCAN(eps, 4, type);
+            expected.fit(points);
+            auto dbscan = BasicDBSCAN<float>(eps, 4, type);
+            dbscan.fit(float_points);
+            ASSERT_EQ(dbscan.database.cluster_ids, expected.database.cluster_ids);
+        }
+    }
+
+    const vector<float> a = {1, 2, 3, 4}, b = {2, 4, 6, 8};
+    ASSERT_EQ(squared_l2(a.data(), b.data(), 4, FixedDim<4>()), 30.0f);
+    ASSERT_EQ(squared_l2(a.data(), b.data(), 4, FixedDim<0>()), 30.0f);
+    ASSERT_EQ(dispatch_dim(3, [](auto fixed_dim) { return size_t(fixed_dim); }), 3);
+    ASSERT_EQ(dispatch_dim(5, [](auto fixed_dim) { return size_t(fixed_dim); }), 0);
+}
+
+TEST(dbscan, fit_stats) {
+    mt19937 engine(29);
+    normal_distribution<double> dist(0, 0.5);
+    Matrix<> points(2000, 2);
+    for (size_t i = 0; i < points.size(); ++i) {
+        points.row_data(i)[0] = dist(engine) + (i % 3) * 4;
+        points.row_data(i)[1] = dist(engine);
+    }
+
+    for (const auto type : {IndexType::grid, IndexType::kd_tree, IndexType::ball_tree,
+                            IndexType::brute_force}) {
+        FitStats stats;
+        auto dbscan = DBSCAN(0.2, 5, type);
+        dbscan.stats = &stats;
+        dbscan.fit(points);
+
+        ASSERT_EQ(stats.phase_seconds.count("index"), 1);
+        ASSERT_EQ(stats.phase_seconds.count("neighbors"), 1);
+        ASSERT_EQ(stats.phase_seconds.count("labeling"), 1);
+        ASSERT_EQ(stats.n_core + stats.n_border + stats.n_noise, points.size());
+        ASSERT_EQ(stats.n_clusters, dbscan.clusters.size());
+        ASSERT_EQ(accumulate(stats.neighbor_histogram.begin(), stats.neighbor_histogram.end(), size_t(0)),
+                  points.size());
+        ASSERT_GT(stats.neighbor_memory, 0);
+
+        size_t n_points = 0, n_distances = 0;
+        for (const auto& load : stats.thread_loads) {
+            n_points += load.n_points;
+            n_distances += load.n_distances;
+        }
+        ASSERT_EQ(n_points, points.size());
+        ASSERT_EQ(n_distances, stats.n_distances);
+        ASSERT_GT(stats.n_distances, 0);
+        if (type == IndexType::brute_force) ASSERT_EQ(stats.n_distances, points.size() * points.size());
+
+        const auto j = stats.to_json();
+        ASSERT_EQ(j["n_core"].get<size_t>(), stats.n_core);
+        ASSERT_EQ(j["thread_loads"].size(), stats.thread_loads.size());
+    }
+
+    FitStats graph_stats;
+    auto graph = build_nn_descent_graph(points);
+    graph.stats = &graph_stats;
+    graph.self_range_search_all(0.2);
+    ASSERT_EQ(graph_stats.phase_seconds.count("graph_search"), 1);
+    ASSERT_GT(graph_stats.n_distances, 0);
+}
+
+TEST(dbscan, save_formats) {
+    mt19937 engine(23);
+    normal_distribution<double> dist(0, 0.5);
+    Matrix<> points(2000, 2);
+    for (size_t i = 0; i < points.size(); ++i) {
+        points.row_data(i)[0] = dist(engine) + (i % 4) * 3;
+        points.row_data(i)[1] = dist(engine);
+    }
+    auto dbscan = DBSCAN(0.2, 8);
+    dbscan.fit(points);
+    const auto& labels = dbscan.database.cluster_ids;
+    const auto kinds = dbscan.point_kinds();
+    ASSERT_NE(count(labels.begin(), labels.end(), -1), 0);
+
+    const string csv_path = "/tmp/dbscan_test_labels.csv";
+    dbscan.save(csv_path, true);
+    {
+        ifstream ifs(csv_path);
+        string line;
+        getline(ifs, line);
+        ASSERT_EQ(line, "cluster_id,kind");
+        for (size_t id = 0; id < labels.size(); ++id) {
+            ASSERT_TRUE(getline(ifs, line));
+            ASSERT_EQ(line, to_string(labels[id]) + "," + point_kind_names[static_cast<int>(kinds[id])]);
+        }
+        ASSERT_FALSE(getline(ifs, line));
+    }
+
+    const string binary_path = "/tmp/dbscan_test_labels.bin";
+    dbscan.save(binary_path, true);
+    vector<PointKind> loaded_kinds;
+    ASSERT_EQ(load_labels(binary_path, &loaded_kinds), labels);
+    ASSERT_EQ(loaded_kinds, kinds);
+    dbscan.save(binary_path);
+    ASSERT_EQ(load_labels(binary_path), labels);
+    ASSERT_THROW(load_labels(binary_path, &loaded_kinds), runtime_error);
+
+    const string clusters_path = "/tmp/dbscan_test_clusters.csv";
+    dbscan.save_clusters(clusters_path);
+    ifstream ifs(clusters_path);
+    string line;
+    for (size_t c = 0; c < dbscan.clusters.size(); ++c) {
+        ASSERT_TRUE(getline(ifs, line));
+        string expected = to_string(c) + "," + to_string(dbscan.clusters[c].size());
+        for (const auto id : dbscan.clusters[c]) expected += "," + to_string(id);
+        ASSERT_EQ(line, expected);
+    }
+    ASSERT_FALSE(getline(ifs, line));
+}
+
+TEST(dbscan, angular_metric) {
+    // directions around a few axes, at random lengths
+    mt19937 engine(29);
+    normal_distribution<double> dist(0, 0.15);
+    uniform_real_distribution<double> length(0.5, 20);
+    Matrix<> points(1500, 3);
+    for (size_t i = 0; i < points.size(); ++i) {
+        const auto scale = length(engine);
+        for (size_t d = 0; d < 3; ++d) points.row_data(i)[d] = scale * (dist(engine) + (i % 3 == d));
+    }
+
+    const double eps = 0.05;
+    vector<vector<int>> lists(points.size());
+    for (int i = 0; i < points.size(); ++i) {
+        for (int j = 0; j < points.size(); ++j) {
+            if (i != j && angular_distance(points[i], points[j]) < eps) lists[i].emplace_back(j);
+        }
+    }
+    auto expected = DBSCAN(eps, 10);
+    expected.fit(points, lists);
+    ASSERT_GT(expected.clusters.size(), 1);
+
+    for (const auto type : {IndexType::brute_force, IndexType::grid, IndexType::kd_tree}) {
+        BasicDBSCAN<double, Angular> dbscan(eps, 10, type);
+        dbscan.fit(points);
+        ASSERT_EQ(dbscan.database.cluster_ids, expected.database.cluster_ids);
+        // the caller's points are left as they were
+        ASSERT_GT(l2_norm(points[0]), 0.5);
+        ASSERT_NEAR(l2_norm(dbscan.database.points[0]), 1, 1e-9);
+    }
+
+    // a graph holding the exact neighborhoods answers with them
+    const BasicGraphIndex<double, Angular> graph(
+            points, build_neighbor_table(points.size(), [&](int id, vector<int>& out) {
+                out.insert(out.end(), lists[id].begin(), lists[id].end());
+            }));
+    const auto table = graph.self_range_search_all(eps);
+    for (int i = 0; i < points.size(); ++i) {
+        ASSERT_EQ(vector<int>(table[i].begin(), table[i].end()), lists[i]);
+    }
+
+    // the graph's points are already mapped and are not copied again
+    BasicDBSCAN<double, Angular> from_graph(eps, 10);
+    from_graph.fit_prepared(graph.points, table);
+    ASSERT_EQ(from_graph.database.cluster_ids, expected.database.cluster_ids);
+    ASSERT_EQ(from_graph.database.points.data(), graph.points.data());
+}
+
+TEST(dbscan, cell_grid) {
+    mt19937 engine(31);
+    normal_distribution<double> dist(0, 0.5);
+    for (const size_t dim : {2, 3, 5}) {
+        Matrix<> points(3000, dim);
+        for (size_t i = 0; i < points.size(); ++i) {
+            for (size_t d = 0; d < dim; ++d) points.row_data(i)[d] = dist(engine) + (i % 4 == d) * 3;
+        }
+        const double eps = dim == 2 ? 0.15 : 0.4;
+        auto expected = DBSCAN(eps, 10);
+        expected.fit(points);
+        ASSERT_GT(expected.clusters.size(), 1);
+
+        auto dbscan = DBSCAN(eps, 10);
+        dbscan.fit_cells(points);
+        ASSERT_EQ(dbscan.database.cluster_ids, expected.database.cluster_ids);
+        ASSERT_EQ(dbscan.point_kinds(), expected.point_kinds());
+        ASSERT_THROW(dbscan.remove({0}), runtime_error);
+
+        // rho-approximate: the same core points and noise, and clusters that
+        // only merge exact ones
+        auto approximate = DBSCAN(eps, 10);
+        approximate.fit_cells(points, 0.5);
+        map<int, int> merged_into;
+        for (int id = 0; id < points.size(); ++id) {
+            if (!expected.is_core(id)) continue;
+            ASSERT_TRUE(approximate.is_core(id));
+            const auto label = expected.database.cluster_ids[id];
+            if (!merged_into.count(label)) merged_into[label] = approximate.database.cluster_ids[id];
+            ASSERT_EQ(merged_into[label], approximate.database.cluster_ids[id]);
+        }
+        ASSERT_LE(approximate.clusters.size(), expected.clusters.size());
+    }
+}
+
+TEST(dbscan, pivot_index) {
+    // 128-dimensional points near a 3-dimensional subspace
+    mt19937 engine(37);
+    normal_distribution<double> dist(0, 1);
+    const size_t n = 2000, dim = 128, latent_dim = 3;
+    vector<double> basis(latent_dim * dim);
+    for (auto& b : basis) b = dist(engine) / sqrt(dim);
+    Matrix<> points(n, dim);
+    for (size_t i = 0; i < n; ++i) {
+        double latent[latent_dim];
+        for (size_t l = 0; l < latent_dim; ++l) latent[l] = dist(engine) + (i % 4 == l) * 6;
+        for (size_t d = 0; d < dim; ++d) {
+            double x = 0.01 * dist(engine);
+            for (size_t l = 0; l < latent_dim; ++l) x += latent[l] * basis[l * dim + d];
+            points.row_data(i)[d] = x;
+        }
+    }
+
+    const double eps = 0.6;
+    const BruteForceIndex brute_force(points);
+    const PivotIndex pivot(points);
+    for (int id = 0; id < n; id += 7) ASSERT_EQ(pivot.range_search(id, eps), brute_force.range_search(id, eps));
+    ASSERT_GT(pivot.n_pruned(), 0);
+
+    auto expected = DBSCAN(eps, 10, IndexType::brute_force);
+    expected.fit(points);
+    ASSERT_GT(expected.clusters.size(), 1);
+    FitStats stats;
+    auto dbscan = DBSCAN(eps, 10, IndexType::pivot);
+    dbscan.stats = &stats;
+    dbscan.fit(points);
+    ASSERT_EQ(dbscan.database.cluster_ids, expected.database.cluster_ids);
+    ASSERT_EQ(stats.n_pruned + stats.n_distances, n * (n - 1));
+    ASSERT_GT(stats.n_pruned, stats.n_distances);
+
+    // k nearest neighbors through the same table
+    Dataset<> dataset;
+    for (size_t i = 0; i < n; ++i) dataset.emplace_back(i, vector<double>(points[i].begin(), points[i].end()));
+    const PivotTable<double> table(points);
+    PivotCounts counts;
+    for (int id = 0; id < n; id += 101) {
+        const auto expected_knn = scan_knn_search(dataset[id], 5, dataset);
+        const auto knn = scan_knn_search(dataset[id], 5, dataset, table, &counts);
+        ASSERT_EQ(knn.size(), 5);
+        for (int i = 0; i < 5; ++i) ASSERT_EQ(knn[i].get().id, expected_knn[i].get().id);
+    }
+    ASSERT_GT(counts.n_pruned, 0);
+}
+
+TEST(dbscan, quantized_index) {
+    // integer kernels agree for every tail length
+    mt19937 engine(41);
+    uniform_int_distribution<int> byte(0, 255);
+    vector<uint8_t> a(100), b(100);
+    for (size_t i = 0; i < a.size(); ++i) {
+        a[i] = byte(engine);
+        b[i] = byte(engine);
+    }
+    for (size_t dim = 0; dim <= a.size(); ++dim) {
+        ASSERT_EQ(squared_l2_u8(a.data(), b.data(), dim), squared_l2_u8_scalar(a.data(), b.data(), dim));
+    }
+
+    normal_distribution<double> dist(0, 0.1);
+    const size_t n = 2000, dim = 64;
+    Matrix<> points(n, dim);
+    Matrix<float> float_points(n, dim);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t d = 0; d < dim; ++d) {
+            points.row_data(i)[d] = dist(engine) + (i % 5 == d % 5) * 0.3;
+            float_points.row_data(i)[d] = points.row_data(i)[d];
+        }
+    }
+
+    // the bounds hold for every pair
+    const QuantizedMatrix<double> quantized(points);
+    ASSERT_LT(quantized.memory_usage(), n * dim * sizeof(double) / 4);
+    for (int i = 0; i < n; i += 13) {
+        for (int j = 0; j < n; j += 7) {
+            const auto code_dist = quantized.step * sqrt(squared_l2_u8(quantized.row_codes(i),
+                                                                      quantized.row_codes(j), dim));
+            const auto exact = euclidean_distance(points[i], points[j]);
+            const auto error = quantized.errors[i] + quantized.errors[j];
+            ASSERT_LE(code_dist - error, exact + 1e-12);
+            ASSERT_GE(code_dist + error, exact - 1e-12);
+        }
+    }
+
+    const double eps = 0.95;
+    const BruteForceIndex brute_force(points);
+    const QuantizedIndex index(points);
+    for (int id = 0; id < n; id += 7) ASSERT_EQ(index.range_search(id, eps), brute_force.range_search(id, eps));
+    ASSERT_GT(index.n_pruned(), 0);
+
+    auto expected = DBSCAN(eps, 10, IndexType::brute_force);
+    expected.fit(points);
+    ASSERT_GT(expected.clusters.size(), 1);
+    FitStats stats;
+    auto dbscan = DBSCAN(eps, 10, IndexType::quantized);
+    dbscan.stats = &stats;
+    dbscan.fit(points);
+    ASSERT_EQ(dbscan.database.cluster_ids, expected.database.cluster_ids);
+    ASSERT_LT(stats.n_distances, n * (n - 1) / 10);
+
+    auto float_expected = BasicDBSCAN<float>(eps, 10, IndexType::brute_force);
+    float_expected.fit(float_points);
+    auto float_dbscan = BasicDBSCAN<float>(eps, 10, IndexType::quantized);
+    float_dbscan.fit(float_points);
+    ASSERT_EQ(float_dbscan.database.cluster_ids, float_expected.database.cluster_ids);
+}
+
+TEST(dbscan, predict) {
+    mt19937 engine(43);
+    normal_distribution<double> dist(0, 0.5);
+    for (const size_t dim : {2, 20}) {
+        const auto make_points = [&](size_t n) {
+            Matrix<> points(n, dim);
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t d = 0; d < dim; ++d) points.row_data(i)[d] = dist(engine) + (i % 3 == d % 3) * 3;
+            }
+            return points;
+        };
+        const auto points = make_points(3000);
+        const double eps = dim == 2 ? 0.2 : 2.5;
+        auto dbscan = DBSCAN(eps, 10);
+        dbscan.fit(points);
+        ASSERT_GT(dbscan.clusters.size(), 1);
+
+        // fitted points: core points keep their cluster, noise stays noise
+        const auto labels = dbscan.predict(points);
+        for (int id = 0; id < points.size(); ++id) {
+            if (dbscan.is_core(id) || dbscan.database.cluster_ids[id] < 0)
+                ASSERT_EQ(labels[id], dbscan.database.cluster_ids[id]);
+            else
+                ASSERT_GE(labels[id], 0);
+        }
+
+        // new points: the cluster of the nearest core point within eps
+        const auto queries = make_points(500);
+        vector<int> expected(queries.size(), -1);
+        for (int i = 0; i < queries.size(); ++i) {
+            auto best = eps * eps;
+            for (int id = 0; id < points.size(); ++id) {
+                const auto d = squared_l2(queries.row_data(i), points.row_data(id), dim);
+                if (dbscan.is_core(id) && d < best) {
+                    best = d;
+                    expected[i] = dbscan.database.cluster_ids[id];
+                }
+            }
+        }
+        vector<int> predicted(queries.size());
+        dbscan.predict(queries, predicted.data());
+        ASSERT_EQ(predicted, expected);
+        ASSERT_NE(count(expected.begin(), expected.end(), -1), 0);
+
+        // the same answers from a mapped model file
+        const string model_path = "/tmp/dbscan_test_model.bin";
+        dbscan.save_model(model_path);
+        const auto model = BasicDBSCANModel<double>::load(model_path);
+        ASSERT_EQ(model.size(), dbscan.model->size());
+        ASSERT_EQ(model.predict(queries), expected);
+        ASSERT_THROW((BasicDBSCANModel<double, Angular>::load(model_path)), runtime_error);
+        ASSERT_THROW(BasicDBSCANModel<float>::load(model_path), runtime_error);
+    }
+}